@@ -1,10 +1,22 @@
 #pragma once
 
-#include <vector>
+#include <array>
+#include <cmath>
 #include <memory>
+#include <optional>
+#include <vector>
+
+#include "Arena.h"
 
+// Polygon vertex lists come from the thread arenas, like the meshes, polylines and entities made with MakeShared
+#define CSG_VERTEX_ALLOCATOR IfcppExample::ArenaAllocator
 #include "csgjs.h"
 #include "earcut.hpp"
+#include "AffineTransform.h"
+#include "EntityMetadata.h"
+#include "PlaneProjection.h"
+#include "Trace.h"
+#include "TriangulationCache.h"
 #include "ifcpp/Geometry/Matrix.h"
 #include "ifcpp/Geometry/StyleConverter.h"
 #include "ifcpp/Geometry/VectorAdapter.h"
@@ -24,6 +36,73 @@ class Mesh {
 public:
     std::vector<csg::Polygon> m_polygons;
     unsigned int m_color = 0;
+    // Geometry shared with other meshes (e.g. repeated mapped items). When set, m_polygons is empty and
+    // the mesh is m_instanceTransform applied to the shared polygons. Adapter keeps the polygons of every mesh
+    // it creates here, the shared list is never modified.
+    std::shared_ptr<const std::vector<csg::Polygon>> m_sharedPolygons;
+    AffineTransform m_instanceTransform;
+
+    // Mesh which keeps the polygons in a new shared list, so copies of it share them
+    static inline std::shared_ptr<Mesh> FromPolygons( std::vector<csg::Polygon>&& polygons, unsigned int color = 0 ) {
+        auto mesh = MakeShared<Mesh>( Mesh { {}, color } );
+        mesh->SetPolygons( std::move( polygons ) );
+        return mesh;
+    }
+
+    [[nodiscard]] inline bool IsInstance() const {
+        return this->m_sharedPolygons != nullptr;
+    }
+
+    // Replaces the geometry of the mesh with a new shared list in world coordinates, other meshes sharing the
+    // previous list keep it
+    inline void SetPolygons( std::vector<csg::Polygon>&& polygons ) {
+        this->m_polygons = {};
+        this->m_sharedPolygons = MakeShared<std::vector<csg::Polygon>>( std::move( polygons ) );
+        this->m_instanceTransform = {};
+    }
+
+    // Replaces the shared geometry with an own copy in world coordinates. When no other mesh shares the list, it
+    // is taken over instead of copied: shared lists are only created by SetPolygons and DeduplicateMeshes as
+    // non-const vectors, and nothing else can reach it.
+    inline void Materialize() {
+        if( !this->IsInstance() ) {
+            return;
+        }
+        if( this->m_sharedPolygons.use_count() == 1 ) {
+            this->m_polygons = std::move( const_cast<std::vector<csg::Polygon>&>( *this->m_sharedPolygons ) );
+            if( !this->m_instanceTransform.IsIdentity() ) {
+                this->m_instanceTransform.TransformPolygons( [ & ]( const auto& callback ) { callback( this->m_polygons ); } );
+            }
+        } else {
+            this->m_polygons = this->CopyPolygons();
+        }
+        this->m_sharedPolygons.reset();
+        this->m_instanceTransform = {};
+    }
+
+    [[nodiscard]] inline std::vector<csg::Polygon> CopyPolygons() const {
+        if( !this->IsInstance() ) {
+            return this->m_polygons;
+        }
+        auto polygons = *this->m_sharedPolygons;
+        if( this->m_instanceTransform.IsIdentity() ) {
+            return polygons;
+        }
+        this->m_instanceTransform.TransformPolygons( [ & ]( const auto& callback ) { callback( polygons ); } );
+        return polygons;
+    }
+
+    // Polygons in world coordinates, transformed instances are materialized into storage
+    [[nodiscard]] inline const std::vector<csg::Polygon>& GetPolygons( std::vector<csg::Polygon>* storage ) const {
+        if( !this->IsInstance() ) {
+            return this->m_polygons;
+        }
+        if( this->m_instanceTransform.IsIdentity() ) {
+            return *this->m_sharedPolygons;
+        }
+        *storage = this->CopyPolygons();
+        return *storage;
+    }
 };
 
 class Entity {
@@ -31,8 +110,14 @@ public:
     std::shared_ptr<IFC4X3::IfcObjectDefinition> m_ifcObject;
     std::vector<std::shared_ptr<Mesh>> m_meshes;
     std::vector<std::shared_ptr<Polyline>> m_polylines;
+    EntityMetadata m_metadata;
 };
 
+// When set, convex loops without holes are triangulated directly instead of going through earcut
+inline bool triangulationFastPath = true;
+
+// Adapter methods are called concurrently by the ifcpp geometry workers. The adapter keeps no mutable state
+// besides the internally locked triangulation cache.
 class Adapter {
 public:
     using TEntity = std::shared_ptr<Entity>;
@@ -47,49 +132,111 @@ public:
             // WTF???
             return {};
         }
-        return csg::Polygon( { vertices[ indices[ 0 ] ], vertices[ indices[ 1 ] ], vertices[ indices[ 2 ] ] } );
+        // The vertex list is allocated once and moved into the polygon
+        return csg::Polygon( csg::VertexList { vertices[ indices[ 0 ] ], vertices[ indices[ 1 ] ], vertices[ indices[ 2 ] ] } );
     }
     inline TPolyline CreatePolyline( const std::vector<TVector>& vertices ) {
-        return std::make_shared<Polyline>( Polyline { vertices } );
+        TRACE_GEOMETRY_STARTED();
+        return MakeShared<Polyline>( Polyline { vertices } );
+    }
+    inline TPolyline CreatePolyline( std::vector<TVector>&& vertices ) {
+        TRACE_GEOMETRY_STARTED();
+        return MakeShared<Polyline>( Polyline { std::move( vertices ) } );
     }
     inline TMesh CreateMesh( const std::vector<TTriangle>& triangles ) {
-        return std::make_shared<Mesh>( Mesh { triangles } );
+        TRACE_GEOMETRY_STARTED();
+        return Mesh::FromPolygons( std::vector<TTriangle>( triangles ) );
+    }
+    inline TMesh CreateMesh( std::vector<TTriangle>&& triangles ) {
+        TRACE_GEOMETRY_STARTED();
+        return Mesh::FromPolygons( std::move( triangles ) );
     }
     inline TPolyline CreatePolyline( const TPolyline& other ) {
-        return std::make_shared<Polyline>( Polyline { other->m_points, other->m_color } );
+        return MakeShared<Polyline>( Polyline { other->m_points, other->m_color } );
     }
+    // Other workers may read the original at the same time, so it is only read. Every mesh made by the adapter
+    // keeps its polygons in immutable shared storage, so the copy shares them with its own transformation
+    // (Transform composes it) and no polygon is copied for repeated mapped items.
     inline TMesh CreateMesh( const TMesh& other ) {
-        return std::make_shared<Mesh>( Mesh { other->m_polygons, other->m_color } );
+        if( !other->IsInstance() ) {
+            return MakeShared<Mesh>( Mesh { other->m_polygons, other->m_color } );
+        }
+        return MakeShared<Mesh>( Mesh { {}, other->m_color, other->m_sharedPolygons, other->m_instanceTransform } );
     }
     inline TEntity CreateEntity( const std::shared_ptr<IFC4X3::IfcObjectDefinition>& ifcObject, const std::vector<TMesh>& meshes,
                                  const std::vector<TPolyline>& polylines ) {
-        return std::make_shared<Entity>( Entity { ifcObject, meshes, polylines } );
+        auto entity =
+            MakeShared<Entity>( Entity { releaseIfcObjects ? nullptr : ifcObject, meshes, polylines, EntityMetadata::FromIfcObject( ifcObject ) } );
+        TRACE_ENTITY_FINISHED( entity->m_metadata.m_type );
+        return entity;
+    }
+    inline TEntity CreateEntity( const std::shared_ptr<IFC4X3::IfcObjectDefinition>& ifcObject, std::vector<TMesh>&& meshes,
+                                 std::vector<TPolyline>&& polylines ) {
+        auto entity = MakeShared<Entity>(
+            Entity { releaseIfcObjects ? nullptr : ifcObject, std::move( meshes ), std::move( polylines ), EntityMetadata::FromIfcObject( ifcObject ) } );
+        TRACE_ENTITY_FINISHED( entity->m_metadata.m_type );
+        return entity;
     }
 
     inline void Transform( std::vector<TMesh>* meshes, const ifcpp::Matrix<TVector>& matrix ) {
+        const auto transform = AffineTransform::FromMatrix( matrix );
         for( auto& m: *meshes ) {
-            for( auto& t: m->m_polygons ) {
-                for( auto& v: t.vertices ) {
-                    matrix.Transform( &v );
+            if( m->IsInstance() ) {
+                m->m_instanceTransform = transform * m->m_instanceTransform;
+            }
+        }
+        transform.TransformPolygons( [ & ]( const auto& callback ) {
+            for( auto& m: *meshes ) {
+                if( !m->IsInstance() ) {
+                    callback( m->m_polygons );
                 }
-                t.plane = csg::Plane( t.vertices );
             }
-            for( long long int i = m->m_polygons.size() - 1; i >= 0; i-- ) {
-                if( !m->m_polygons[ i ].plane.IsValid() ) {
-                    m->m_polygons.erase( m->m_polygons.begin() + i );
+        } );
+    }
+    inline void Transform( std::vector<TPolyline>* polylines, const ifcpp::Matrix<TVector>& matrix ) {
+        AffineTransform::FromMatrix( matrix ).TransformPoints( [ & ]( const auto& callback ) {
+            for( auto& p: *polylines ) {
+                for( auto& v: p->m_points ) {
+                    callback( v );
                 }
             }
+        } );
+    }
+
+    inline void AddStyles( std::vector<TMesh>* meshes, const std::vector<std::shared_ptr<ifcpp::Style>>& styles ) {
+        TRACE_SCOPE( "AddStyles" );
+        const auto color = GetSurfaceColor( styles );
+        if( !color ) {
+            return;
+        }
+        for( auto& m: *meshes ) {
+            if( !m->m_color ) {
+                m->m_color = color;
+            }
         }
     }
-    inline void Transform( std::vector<TPolyline>* polylines, const ifcpp::Matrix<TVector>& matrix ) {
+    inline void AddStyles( std::vector<TPolyline>* polylines, const std::vector<std::shared_ptr<ifcpp::Style>>& styles ) {
+        TRACE_SCOPE( "AddStyles" );
+        std::shared_ptr<ifcpp::Style> style;
+        for( const auto& s: styles ) {
+            if( s->m_type == ifcpp::Style::CURVE ) {
+                style = s;
+                break;
+            }
+        }
+        if( !style ) {
+            return;
+        }
         for( auto& p: *polylines ) {
-            for( auto& v: p->m_points ) {
-                matrix.Transform( &v );
+            if( !p->m_color ) {
+                p->m_color = (int)( 255.0f * style->m_color.a ) << 24 | (int)( 255.0f * style->m_color.b ) << 16 | (int)( 255.0f * style->m_color.g ) << 8 |
+                    (int)( 255.0f * style->m_color.r );
             }
         }
     }
 
-    inline void AddStyles( std::vector<TMesh>* meshes, const std::vector<std::shared_ptr<ifcpp::Style>>& styles ) {
+    // Color of the first surface style, packed as ABGR, or 0 if there is none
+    static inline unsigned int GetSurfaceColor( const std::vector<std::shared_ptr<ifcpp::Style>>& styles ) {
         std::shared_ptr<ifcpp::Style> style;
         for( const auto& s: styles ) {
             if( s->m_type == ifcpp::Style::SURFACE_FRONT ) {
@@ -118,170 +265,259 @@ public:
             }
         }
         if( !style ) {
-            return;
-        }
-        for( auto& m: *meshes ) {
-            if( !m->m_color ) {
-                m->m_color = (int)( 255.0f * style->m_color.a ) << 24 | (int)( 255.0f * style->m_color.b ) << 16 | (int)( 255.0f * style->m_color.g ) << 8 |
-                    (int)( 255.0f * style->m_color.r );
-            }
-        }
-    }
-    inline void AddStyles( std::vector<TPolyline>* polylines, const std::vector<std::shared_ptr<ifcpp::Style>>& styles ) {
-        std::shared_ptr<ifcpp::Style> style;
-        for( const auto& s: styles ) {
-            if( s->m_type == ifcpp::Style::CURVE ) {
-                style = s;
-                break;
-            }
-        }
-        if( !style ) {
-            return;
-        }
-        for( auto& p: *polylines ) {
-            if( !p->m_color ) {
-                p->m_color = (int)( 255.0f * style->m_color.a ) << 24 | (int)( 255.0f * style->m_color.b ) << 16 | (int)( 255.0f * style->m_color.g ) << 8 |
-                    (int)( 255.0f * style->m_color.r );
-            }
+            return 0;
         }
+        return (int)( 255.0f * style->m_color.a ) << 24 | (int)( 255.0f * style->m_color.b ) << 16 | (int)( 255.0f * style->m_color.g ) << 8 |
+            (int)( 255.0f * style->m_color.r );
     }
 
     inline std::vector<int> Triangulate( const std::vector<TVector>& loop ) {
-        if( loop.size() < 3 ) {
-            return {};
-        }
-
-        TVector normal( 0, 0, 0 );
-        TVector origin = loop[ 0 ];
-        for( const auto& a: loop ) {
-            for( const auto& b: loop ) {
-                for( const auto& c: loop ) {
-                    const auto n = -csg::Cross( a - b, c - b );
-                    if( csg::LengthSquared( n ) > csg::LengthSquared( normal ) ) {
-                        normal = n;
-                    }
-                    if( csg::LengthSquared( normal ) > 1e-6 ) {
-                        goto BREAK;
-                    }
-                }
-            }
-        }
-    BREAK:
-        normal = csg::Normalized( normal );
-
-        auto right = csg::Cross( { 0.0f, 0.0f, 1.0f }, normal );
-        if( csg::LengthSquared( right ) < 1e-6 ) {
-            right = csg::Cross( normal, { 0.0f, -1.0f, 0.0f } );
-        }
-        right = csg::Normalized( right );
-        auto up = csg::Normalized( csg::Cross( normal, right ) );
-
-
-        std::vector<std::tuple<double, double>> outer;
-
-        double minx = std::numeric_limits<double>::max(), miny = std::numeric_limits<double>::max();
-
-        for( const auto& p: loop ) {
-            double x = csg::Dot( right, p - origin );
-            double y = csg::Dot( up, p - origin );
-            outer.emplace_back( x, y );
-            minx = std::min( minx, x );
-            miny = std::min( miny, y );
-        }
-
-        for( auto& p: outer ) {
-            const auto [ x, y ] = p;
-            p = { x - minx, y - miny };
-        }
-
-        double s = 0.0f;
-        outer.push_back( outer[ 0 ] );
-        for( int i = 1; i < outer.size(); i++ ) {
-            auto [ x1, y1 ] = outer[ i - 1 ];
-            auto [ x2, y2 ] = outer[ i ];
-            s += ( y1 + y2 ) * 0.5f * ( x1 - x2 );
-        }
-        outer.pop_back();
-
-
-        std::vector<std::vector<std::tuple<double, double>>> polygon = { outer };
-        auto result = mapbox::earcut<int>( polygon );
-        if( s < 0 ) {
-            std::reverse( std::begin( result ), std::end( result ) );
-        }
-        for( int i = 1; i < result.size(); i += 3 ) {
-            const auto& a = loop[ result[ i - 1 ] ];
-            const auto& b = loop[ result[ i ] ];
-            const auto& c = loop[ result[ i + 1 ] ];
-            if( csg::LengthSquared( csg::Cross( b - a, c - b ) ) < 1e-12 ) {
-                result.erase( result.begin() + i - 1, result.begin() + i + 2 );
-                i -= 3;
-            }
-        }
-        return result;
+        TRACE_GEOMETRY_STARTED();
+        TRACE_SCOPE( "Triangulate" );
+        return TriangulateLoops( &loop, 1 );
+    }
+    // Outer loop followed by its inner loops (holes), indices refer to the vertices of all loops in order
+    inline std::vector<int> Triangulate( const std::vector<std::vector<TVector>>& loops ) {
+        TRACE_GEOMETRY_STARTED();
+        TRACE_SCOPE( "Triangulate" );
+        return TriangulateLoops( loops.data(), loops.size() );
     }
 
     inline std::vector<TMesh> ComputeUnion( const std::vector<TMesh>& operand1, const std::vector<TMesh>& operand2 ) {
+        TRACE_SCOPE( "ComputeUnion" );
         if( operand1.empty() ) {
             return operand2;
         } else if( operand2.empty() ) {
             return operand1;
         }
 
+        std::vector<unsigned int> colors;
         csg::details::CSGNode resultNode;
-        for( const auto& operand: operand1 ) {
-            auto n = csg::details::CSGNode( operand->m_polygons );
-            csg::details::UnionInplace( &resultNode, &n );
-        }
-        for( const auto& operand: operand2 ) {
-            auto n = csg::details::CSGNode( operand->m_polygons );
-            csg::details::UnionInplace( &resultNode, &n );
+        for( const auto& operands: { &operand1, &operand2 } ) {
+            for( const auto& operand: *operands ) {
+                auto n = csg::details::CSGNode( TagPolygons( operand, operand1[ 0 ]->m_color, &colors ) );
+                csg::details::UnionInplace( &resultNode, &n );
+                resultNode.Compact();
+            }
         }
 
-        // TODO: Fix styles (m_color) when we have several operand1 meshes
-        TMesh result = std::make_shared<Mesh>( Mesh { resultNode.allpolygons(), operand1[ 0 ]->m_color } );
-        return { result };
+        return SplitByColor( resultNode.allpolygons(), colors );
     }
     inline std::vector<TMesh> ComputeIntersection( const std::vector<TMesh>& operand1, const std::vector<TMesh>& operand2 ) {
+        TRACE_SCOPE( "ComputeIntersection" );
         if( operand1.empty() || operand2.empty() ) {
             return {};
         }
 
         csg::details::CSGNode operand2node;
+        std::vector<csg::Polygon> storage;
         for( const auto& operand: operand2 ) {
-            auto n = csg::details::CSGNode( operand->m_polygons );
+            auto n = csg::details::CSGNode( operand->GetPolygons( &storage ) );
             csg::details::UnionInplace( &operand2node, &n );
+            operand2node.Compact();
         }
 
+        // The results get new shared lists, copies of the operands keep the previous ones
         for( auto& operand: operand1 ) {
-            auto resultNode = std::make_unique<csg::details::CSGNode>( operand->m_polygons );
+            auto resultNode = std::make_unique<csg::details::CSGNode>( operand->GetPolygons( &storage ) );
             csg::details::IntersectionInplace( resultNode.get(), &operand2node );
-            operand->m_polygons = resultNode->allpolygons();
+            operand->SetPolygons( resultNode->allpolygons() );
         }
 
         return operand1;
     }
     inline std::vector<TMesh> ComputeDifference( const std::vector<TMesh>& operand1, const std::vector<TMesh>& operand2 ) {
+        TRACE_SCOPE( "ComputeDifference" );
         if( operand1.empty() || operand2.empty() ) {
             return operand1;
         }
 
         std::vector<csg::details::CSGNode> operand2nodes;
         operand2nodes.reserve( operand2.size() );
+        std::vector<csg::Polygon> storage;
         for( const auto& o: operand2 ) {
-            operand2nodes.emplace_back( o->m_polygons );
+            operand2nodes.emplace_back( o->GetPolygons( &storage ) );
         }
 
         for( auto& o1: operand1 ) {
-            auto resultNode = std::make_unique<csg::details::CSGNode>( o1->m_polygons );
+            auto resultNode = std::make_unique<csg::details::CSGNode>( o1->GetPolygons( &storage ) );
             for( const auto& o2: operand2nodes ) {
                 csg::details::DifferenceInplace( resultNode.get(), &o2 );
+                resultNode->Compact();
             }
-            o1->m_polygons = resultNode->allpolygons();
+            o1->SetPolygons( resultNode->allpolygons() );
         }
 
         return operand1;
     }
+
+protected:
+    // Projects the loops onto the plane of the outer loop and triangulates them with a single earcut call.
+    // The normal is computed with Newell's method, so the projected outer loop is always counter-clockwise.
+    static inline std::vector<int> TriangulateLoops( const std::vector<TVector>* loops, size_t loopsCount ) {
+        if( loopsCount == 0 || loops[ 0 ].size() < 3 ) {
+            return {};
+        }
+
+        const auto frame = PlaneFrame::FromLoop( loops[ 0 ] );
+        if( !frame ) {
+            return {};
+        }
+        if( loopsCount == 1 && triangulationFastPath ) {
+            std::vector<int> result;
+            if( TriangulateConvex( loops[ 0 ], *frame, &result ) ) {
+                return result;
+            }
+        }
+        auto& context = GetTriangulationContext();
+        context.m_polygon.clear();
+        context.m_vertices.clear();
+        for( size_t l = 0; l < loopsCount; l++ ) {
+            context.m_polygon.push_back( { &loops[ l ], &*frame } );
+            for( const auto& p: loops[ l ] ) {
+                context.m_vertices.push_back( &p );
+            }
+        }
+        const auto& polygon = context.m_polygon;
+        const auto& vertices = context.m_vertices;
+
+        std::optional<TriangulationCache::Key> key;
+        if( vertices.size() >= TriangulationCache::MIN_VERTICES_COUNT ) {
+            key.emplace( polygon );
+            if( auto cached = TriangulationCache::Get().Find( *key ) ) {
+                return std::move( *cached );
+            }
+        }
+
+        auto& earcut = context.m_earcut;
+        earcut( polygon );
+        // Degenerate triangles are dropped while copying out of the reused index buffer
+        std::vector<int> result;
+        result.reserve( earcut.indices.size() );
+        for( size_t i = 0; i + 2 < earcut.indices.size(); i += 3 ) {
+            const auto& a = *vertices[ earcut.indices[ i ] ];
+            const auto& b = *vertices[ earcut.indices[ i + 1 ] ];
+            const auto& c = *vertices[ earcut.indices[ i + 2 ] ];
+            if( csg::LengthSquared( csg::Cross( b - a, c - b ) ) < 1e-12 ) {
+                continue;
+            }
+            result.insert( result.end(), earcut.indices.begin() + i, earcut.indices.begin() + i + 3 );
+        }
+        if( key ) {
+            TriangulationCache::Get().Insert( std::move( *key ), result );
+        }
+        return result;
+    }
+
+    // Fans a convex loop, quads are split along the shorter diagonal. Returns false without touching result if the
+    // loop turns right anywhere or winds around more than once, e.g. a pentagram. The projected loop is counter-
+    // clockwise, like the earcut triangles, and collinear vertices only produce degenerate triangles, which are dropped.
+    static inline bool TriangulateConvex( const std::vector<TVector>& loop, const PlaneFrame& frame, std::vector<int>* result ) {
+        auto& points = GetTriangulationContext().m_points;
+        points.clear();
+        for( const auto& p: loop ) {
+            points.push_back( { frame.X( p ), frame.Y( p ) } );
+        }
+        const int n = (int)points.size();
+        auto cross = [ & ]( int a, int b, int c ) {
+            return ( points[ b ][ 0 ] - points[ a ][ 0 ] ) * ( points[ c ][ 1 ] - points[ b ][ 1 ] ) -
+                ( points[ b ][ 1 ] - points[ a ][ 1 ] ) * ( points[ c ][ 0 ] - points[ b ][ 0 ] );
+        };
+        // Product of the lengths of ab and bc, the tolerances of the cross products are relative to it, so they
+        // don't depend on the model units
+        auto scale = [ & ]( int a, int b, int c ) {
+            return ( std::fabs( points[ b ][ 0 ] - points[ a ][ 0 ] ) + std::fabs( points[ b ][ 1 ] - points[ a ][ 1 ] ) ) *
+                ( std::fabs( points[ c ][ 0 ] - points[ b ][ 0 ] ) + std::fabs( points[ c ][ 1 ] - points[ b ][ 1 ] ) );
+        };
+        auto sign = []( double value ) { return ( value > 0 ) - ( value < 0 ); };
+
+        // Edge directions of the last edge, so that the first edge is compared with it as well
+        std::array<int, 2> lastSigns = { sign( points[ 0 ][ 0 ] - points[ n - 1 ][ 0 ] ), sign( points[ 0 ][ 1 ] - points[ n - 1 ][ 1 ] ) };
+        std::array<int, 2> signChanges = { 0, 0 };
+        for( int previous = n - 1, current = 0; current < n; previous = current++ ) {
+            const int next = current + 1 < n ? current + 1 : 0;
+            const auto& b = points[ current ];
+            const auto& c = points[ next ];
+            if( cross( previous, current, next ) < -1e-9 * scale( previous, current, next ) ) {
+                return false;
+            }
+            // The direction along each axis changes exactly twice around a convex loop
+            for( int axis = 0; axis < 2; axis++ ) {
+                const int s = sign( c[ axis ] - b[ axis ] );
+                if( s != 0 ) {
+                    if( lastSigns[ axis ] != 0 && s != lastSigns[ axis ] && ++signChanges[ axis ] > 2 ) {
+                        return false;
+                    }
+                    lastSigns[ axis ] = s;
+                }
+            }
+        }
+
+        auto addTriangle = [ & ]( int a, int b, int c ) {
+            if( cross( a, b, c ) > 1e-9 * scale( a, b, c ) ) {
+                result->push_back( a );
+                result->push_back( b );
+                result->push_back( c );
+            }
+        };
+        result->reserve( ( n - 2 ) * 3 );
+        if( n == 4 && csg::LengthSquared( loop[ 2 ] - loop[ 0 ] ) > csg::LengthSquared( loop[ 3 ] - loop[ 1 ] ) ) {
+            addTriangle( 1, 2, 3 );
+            addTriangle( 3, 0, 1 );
+            return true;
+        }
+        for( int i = 1; i + 1 < n; i++ ) {
+            addTriangle( 0, i, i + 1 );
+        }
+        return true;
+    }
+
+    // Copies mesh polygons, tagging them with the index of the mesh color in colors, so that the
+    // result of a boolean operation over several meshes can be split back by material
+    static inline std::vector<csg::Polygon> TagPolygons( const TMesh& mesh, unsigned int defaultColor, std::vector<unsigned int>* colors ) {
+        const auto color = mesh->m_color ? mesh->m_color : defaultColor;
+        auto it = std::find( colors->begin(), colors->end(), color );
+        if( it == colors->end() ) {
+            it = colors->insert( colors->end(), color );
+        }
+        const auto attribute = (uint32_t)std::distance( colors->begin(), it );
+
+        auto polygons = mesh->CopyPolygons();
+        for( auto& p: polygons ) {
+            p.attribute = attribute;
+        }
+        return polygons;
+    }
+
+    static inline std::vector<TMesh> SplitByColor( std::vector<csg::Polygon> polygons, const std::vector<unsigned int>& colors ) {
+        std::vector<std::vector<csg::Polygon>> split( colors.size() );
+        for( auto& p: polygons ) {
+            split[ p.attribute ].push_back( std::move( p ) );
+        }
+        std::vector<TMesh> result;
+        result.reserve( colors.size() );
+        for( size_t c = 0; c < colors.size(); c++ ) {
+            if( !split[ c ].empty() ) {
+                result.push_back( Mesh::FromPolygons( std::move( split[ c ] ), colors[ c ] ) );
+            }
+        }
+        return result;
+    }
+
+    // Buffers of the calling thread reused by every triangulation, once they have grown to the largest polygon
+    // seen only the returned indices are allocated
+    struct TriangulationContext {
+        mapbox::detail::Earcut<int> m_earcut;
+        std::vector<ProjectedLoop> m_polygon;
+        std::vector<const TVector*> m_vertices;
+        // Projected loop of the convex fast path
+        std::vector<std::array<double, 2>> m_points;
+    };
+
+    static inline TriangulationContext& GetTriangulationContext() {
+        thread_local TriangulationContext context;
+        return context;
+    }
 };
 
 };
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+#include "csgjs.h"
+
+
+namespace IfcppExample {
+
+
+// 3x4 affine transformation, p' = L * p + t, stored row by row as [ L | t ]
+class AffineTransform {
+public:
+    // Number of vertices transformed at once by TransformBatch
+    static constexpr size_t BATCH_SIZE = 256;
+
+    std::array<double, 12> m_data { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 };
+
+    // Recovers the transformation from any matrix type which can transform csg::Vector in place
+    template<typename TMatrix>
+    static inline AffineTransform FromMatrix( const TMatrix& matrix ) {
+        csg::Vector o( 0, 0, 0 ), x( 1, 0, 0 ), y( 0, 1, 0 ), z( 0, 0, 1 );
+        matrix.Transform( &o );
+        matrix.Transform( &x );
+        matrix.Transform( &y );
+        matrix.Transform( &z );
+        x = x - o;
+        y = y - o;
+        z = z - o;
+        return { { x.x, y.x, z.x, o.x, x.y, y.y, z.y, o.y, x.z, y.z, z.z, o.z } };
+    }
+
+    [[nodiscard]] inline csg::Vector Apply( const csg::Vector& p ) const {
+        const auto& m = this->m_data;
+        return { m[ 0 ] * p.x + m[ 1 ] * p.y + m[ 2 ] * p.z + m[ 3 ], m[ 4 ] * p.x + m[ 5 ] * p.y + m[ 6 ] * p.z + m[ 7 ],
+                 m[ 8 ] * p.x + m[ 9 ] * p.y + m[ 10 ] * p.z + m[ 11 ] };
+    }
+
+    [[nodiscard]] inline bool IsIdentity() const {
+        return this->m_data == AffineTransform().m_data;
+    }
+
+    // Returns the transformation which applies other first and then this
+    [[nodiscard]] inline AffineTransform operator*( const AffineTransform& other ) const {
+        const auto& a = this->m_data;
+        const auto& b = other.m_data;
+        AffineTransform result;
+        for( int r = 0; r < 3; r++ ) {
+            for( int c = 0; c < 4; c++ ) {
+                result.m_data[ r * 4 + c ] = a[ r * 4 ] * b[ c ] + a[ r * 4 + 1 ] * b[ 4 + c ] + a[ r * 4 + 2 ] * b[ 8 + c ] + ( c == 3 ? a[ r * 4 + 3 ] : 0 );
+            }
+        }
+        return result;
+    }
+
+    [[nodiscard]] inline double Determinant() const {
+        const auto& m = this->m_data;
+        return m[ 0 ] * ( m[ 5 ] * m[ 10 ] - m[ 6 ] * m[ 9 ] ) - m[ 1 ] * ( m[ 4 ] * m[ 10 ] - m[ 6 ] * m[ 8 ] ) +
+            m[ 2 ] * ( m[ 4 ] * m[ 9 ] - m[ 5 ] * m[ 8 ] );
+    }
+
+    // Cofactor matrix of L, which is det( L ) * inverse-transpose( L ). It maps the normal of a polygon to the
+    // normal of the transformed polygon, including the flip caused by mirroring, just like recomputing the
+    // normal from the transformed vertices would.
+    [[nodiscard]] inline std::array<double, 9> CofactorMatrix() const {
+        const auto& m = this->m_data;
+        return { m[ 5 ] * m[ 10 ] - m[ 6 ] * m[ 9 ], m[ 6 ] * m[ 8 ] - m[ 4 ] * m[ 10 ], m[ 4 ] * m[ 9 ] - m[ 5 ] * m[ 8 ],
+                 m[ 2 ] * m[ 9 ] - m[ 1 ] * m[ 10 ], m[ 0 ] * m[ 10 ] - m[ 2 ] * m[ 8 ], m[ 1 ] * m[ 8 ] - m[ 0 ] * m[ 9 ],
+                 m[ 1 ] * m[ 6 ] - m[ 2 ] * m[ 5 ], m[ 2 ] * m[ 4 ] - m[ 0 ] * m[ 6 ], m[ 0 ] * m[ 5 ] - m[ 1 ] * m[ 4 ] };
+    }
+
+    [[nodiscard]] inline csg::Plane TransformPlane( const csg::Plane& plane, const std::array<double, 9>& cofactor,
+                                                    const csg::Vector& transformedPoint ) const {
+        if( !plane.IsValid() ) {
+            return plane;
+        }
+        const auto& c = cofactor;
+        const auto& n = plane.normal;
+        const csg::Vector normal( c[ 0 ] * n.x + c[ 1 ] * n.y + c[ 2 ] * n.z, c[ 3 ] * n.x + c[ 4 ] * n.y + c[ 5 ] * n.z,
+                                  c[ 6 ] * n.x + c[ 7 ] * n.y + c[ 8 ] * n.z );
+        csg::Plane result;
+        const auto length = csg::Length( normal );
+        if( length > 0 ) {
+            result.normal = normal / length;
+            result.w = csg::Dot( result.normal, transformedPoint );
+        }
+        return result;
+    }
+
+    // Transforms count <= BATCH_SIZE points stored as separate coordinate arrays. The loop has no
+    // dependencies between iterations and is vectorized by the compiler.
+    inline void TransformBatch( double* x, double* y, double* z, size_t count ) const {
+        const auto& m = this->m_data;
+        const double m0 = m[ 0 ], m1 = m[ 1 ], m2 = m[ 2 ], m3 = m[ 3 ];
+        const double m4 = m[ 4 ], m5 = m[ 5 ], m6 = m[ 6 ], m7 = m[ 7 ];
+        const double m8 = m[ 8 ], m9 = m[ 9 ], m10 = m[ 10 ], m11 = m[ 11 ];
+        for( size_t i = 0; i < count; i++ ) {
+            const double px = x[ i ], py = y[ i ], pz = z[ i ];
+            x[ i ] = m0 * px + m1 * py + m2 * pz + m3;
+            y[ i ] = m4 * px + m5 * py + m6 * pz + m7;
+            z[ i ] = m8 * px + m9 * py + m10 * pz + m11;
+        }
+    }
+
+    // Transforms points in place: they are gathered into batches of coordinate arrays, transformed with
+    // TransformBatch and scattered back. forEachPoint( callback ) must call callback( csg::Vector& ) for every point.
+    template<typename TForEachPoint>
+    inline void TransformPoints( const TForEachPoint& forEachPoint ) const {
+        alignas( 64 ) double x[ BATCH_SIZE ], y[ BATCH_SIZE ], z[ BATCH_SIZE ];
+        csg::Vector* points[ BATCH_SIZE ];
+        size_t count = 0;
+
+        auto flush = [ & ]() {
+            this->TransformBatch( x, y, z, count );
+            for( size_t i = 0; i < count; i++ ) {
+                *points[ i ] = { x[ i ], y[ i ], z[ i ] };
+            }
+            count = 0;
+        };
+
+        forEachPoint( [ & ]( csg::Vector& p ) {
+            points[ count ] = &p;
+            x[ count ] = p.x;
+            y[ count ] = p.y;
+            z[ count ] = p.z;
+            if( ++count == BATCH_SIZE ) {
+                flush();
+            }
+        } );
+        flush();
+    }
+
+    // Transforms polygons in place and removes the ones which became degenerate. Planes are mapped with the
+    // cofactor matrix, unless the transformation flattens the geometry. forEachPolygons( callback ) must call
+    // callback( std::vector<csg::Polygon>& ) for every polygon list.
+    template<typename TForEachPolygons>
+    inline void TransformPolygons( const TForEachPolygons& forEachPolygons ) const {
+        this->TransformPoints( [ & ]( const auto& callback ) {
+            forEachPolygons( [ & ]( std::vector<csg::Polygon>& polygons ) {
+                for( auto& t: polygons ) {
+                    for( auto& v: t.vertices ) {
+                        callback( v );
+                    }
+                }
+            } );
+        } );
+
+        const auto& d = this->m_data;
+        const auto scale = std::sqrt( ( d[ 0 ] * d[ 0 ] + d[ 4 ] * d[ 4 ] + d[ 8 ] * d[ 8 ] ) * ( d[ 1 ] * d[ 1 ] + d[ 5 ] * d[ 5 ] + d[ 9 ] * d[ 9 ] ) *
+                                      ( d[ 2 ] * d[ 2 ] + d[ 6 ] * d[ 6 ] + d[ 10 ] * d[ 10 ] ) );
+        const bool isDegenerate = std::fabs( this->Determinant() ) <= 1e-9 * scale;
+        const auto cofactor = this->CofactorMatrix();
+        forEachPolygons( [ & ]( std::vector<csg::Polygon>& polygons ) {
+            for( auto& t: polygons ) {
+                if( isDegenerate || t.vertices.empty() ) {
+                    t.plane = csg::Plane( t.vertices );
+                } else {
+                    t.plane = this->TransformPlane( t.plane, cofactor, t.vertices[ 0 ] );
+                }
+            }
+            std::erase_if( polygons, []( const csg::Polygon& t ) { return !t.plane.IsValid(); } );
+        } );
+    }
+};
+
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+
+namespace IfcppExample {
+
+
+// When cleared, ThreadArena passes every allocation on to the global heap, which gives the default allocator
+// baseline of the benchmarks. Blocks may be freed with either setting.
+inline bool useThreadArena = true;
+
+// Per-thread caches of small freed blocks. Geometry workers allocate meshes, polylines and polygon vertex lists
+// mostly from blocks their own thread freed before, without touching the global heap. Every block is a heap
+// allocation of its size class, so it may be freed on any thread: it joins the cache of that thread unless the
+// cache of its size class is full, then it goes back to the heap. A finished thread returns its whole cache.
+class ThreadArena {
+public:
+    static constexpr size_t GRANULARITY = 16;
+    static constexpr size_t MAX_BLOCK_SIZE = 512;
+    // Per size class and thread, which bounds the cached memory to 2 MB per thread
+    static constexpr size_t MAX_CACHED_BYTES = 64 * 1024;
+
+    static inline void* Allocate( size_t size ) {
+        auto arena = Local();
+        if( arena ) {
+            arena->m_allocationsCount++;
+        }
+        if( size > MAX_BLOCK_SIZE ) {
+            return ::operator new( size );
+        }
+        const auto sizeClass = SizeClass( size );
+        if( !arena || !useThreadArena ) {
+            return ::operator new( BlockSize( sizeClass ) );
+        }
+        return arena->Pop( sizeClass );
+    }
+
+    static inline void Deallocate( void* p, size_t size ) noexcept {
+        auto arena = Local();
+        if( size > MAX_BLOCK_SIZE || !arena || !useThreadArena ) {
+            ::operator delete( p );
+            return;
+        }
+        arena->Push( SizeClass( size ), p );
+    }
+
+    // Number of allocations made on the calling thread so far
+    static inline size_t GetAllocationsCount() {
+        auto arena = Local();
+        return arena ? arena->m_allocationsCount : 0;
+    }
+
+    ThreadArena() = default;
+    ThreadArena( const ThreadArena& ) = delete;
+    ThreadArena& operator=( const ThreadArena& ) = delete;
+
+    ~ThreadArena() {
+        isDestroyed = true;
+        for( auto block: this->m_freeLists ) {
+            while( block ) {
+                const auto next = block->m_next;
+                ::operator delete( block );
+                block = next;
+            }
+        }
+    }
+
+private:
+    static constexpr size_t SIZE_CLASSES = MAX_BLOCK_SIZE / GRANULARITY;
+
+    struct FreeBlock {
+        FreeBlock* m_next;
+    };
+
+    // Blocks freed by objects destroyed after the arena of their thread, e.g. during static deinitialization, go
+    // straight to the heap
+    static inline thread_local bool isDestroyed = false;
+
+    std::array<FreeBlock*, SIZE_CLASSES> m_freeLists {};
+    std::array<size_t, SIZE_CLASSES> m_freeCounts {};
+    size_t m_allocationsCount = 0;
+
+    static inline size_t SizeClass( size_t size ) {
+        return size ? ( size - 1 ) / GRANULARITY : 0;
+    }
+
+    static inline size_t BlockSize( size_t sizeClass ) {
+        return ( sizeClass + 1 ) * GRANULARITY;
+    }
+
+    static inline ThreadArena* Local() {
+        if( isDestroyed ) {
+            return nullptr;
+        }
+        thread_local ThreadArena arena;
+        return &arena;
+    }
+
+    inline void* Pop( size_t sizeClass ) {
+        if( auto block = this->m_freeLists[ sizeClass ] ) {
+            this->m_freeLists[ sizeClass ] = block->m_next;
+            this->m_freeCounts[ sizeClass ]--;
+            return block;
+        }
+        return ::operator new( BlockSize( sizeClass ) );
+    }
+
+    inline void Push( size_t sizeClass, void* p ) noexcept {
+        if( ( this->m_freeCounts[ sizeClass ] + 1 ) * BlockSize( sizeClass ) > MAX_CACHED_BYTES ) {
+            ::operator delete( p );
+            return;
+        }
+        auto block = static_cast<FreeBlock*>( p );
+        block->m_next = this->m_freeLists[ sizeClass ];
+        this->m_freeLists[ sizeClass ] = block;
+        this->m_freeCounts[ sizeClass ]++;
+    }
+};
+
+template<typename T>
+class ArenaAllocator {
+public:
+    static_assert( alignof( T ) <= ThreadArena::GRANULARITY );
+
+    using value_type = T;
+
+    ArenaAllocator() noexcept = default;
+    template<typename U>
+    ArenaAllocator( const ArenaAllocator<U>& ) noexcept {
+    }
+
+    inline T* allocate( size_t n ) {
+        return static_cast<T*>( ThreadArena::Allocate( n * sizeof( T ) ) );
+    }
+    inline void deallocate( T* p, size_t n ) noexcept {
+        ThreadArena::Deallocate( p, n * sizeof( T ) );
+    }
+
+    template<typename U>
+    inline bool operator==( const ArenaAllocator<U>& ) const noexcept {
+        return true;
+    }
+};
+
+// std::make_shared counterpart which places the object and its control block into the thread arena
+template<typename T, typename... TArgs>
+inline std::shared_ptr<T> MakeShared( TArgs&&... args ) {
+    return std::allocate_shared<T>( ArenaAllocator<T>(), std::forward<TArgs>( args )... );
+}
+
+};
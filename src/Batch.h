@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include <ifcpp/ModelLoader.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "Adapter.h"
+#include "Consolidation.h"
+#include "Deduplication.h"
+#include "GlbExporter.h"
+#include "Json.h"
+#include "MappedFile.h"
+#include "ModelCache.h"
+#include "Polylines.h"
+#include "Trace.h"
+
+
+namespace IfcppExample {
+
+
+// What processing one IFC file without a window took and produced, written as <file>.stats.json
+class BatchFileStats {
+public:
+    std::string m_path;
+    std::string m_error;
+    size_t m_entitiesCount = 0;
+    size_t m_meshesCount = 0;
+    size_t m_trianglesCount = 0;
+    size_t m_polylinesCount = 0;
+    // Polygons of the loaded entities, shared geometry counted once
+    size_t m_geometryBytes = 0;
+    // Buffers which the viewer would upload
+    size_t m_gpuBytes = 0;
+    // Peak resident memory of the whole process when the file was finished, it includes the files processed at
+    // the same time
+    size_t m_processPeakBytes = 0;
+    int m_threadsCount = 0;
+    double m_loadMilliseconds = 0;
+    double m_deduplicateMilliseconds = 0;
+    double m_consolidateMilliseconds = 0;
+    double m_linesMilliseconds = 0;
+    double m_cacheMilliseconds = 0;
+    double m_glbMilliseconds = 0;
+    double m_totalMilliseconds = 0;
+
+    [[nodiscard]] inline std::string ToJson() const {
+        return fmt::format( "{{\n"
+                            "  \"file\": \"{}\",\n"
+                            "  \"success\": {},\n"
+                            "  \"error\": \"{}\",\n"
+                            "  \"threads\": {},\n"
+                            "  \"entities\": {},\n"
+                            "  \"meshes\": {},\n"
+                            "  \"triangles\": {},\n"
+                            "  \"polylines\": {},\n"
+                            "  \"memory\": {{ \"geometry_bytes\": {}, \"gpu_bytes\": {}, \"process_peak_bytes\": {} }},\n"
+                            "  \"phases_ms\": {{ \"load\": {:.1f}, \"deduplicate\": {:.1f}, \"consolidate\": {:.1f}, \"lines\": {:.1f}, "
+                            "\"cache\": {:.1f}, \"glb\": {:.1f}, \"total\": {:.1f} }}\n"
+                            "}}\n",
+                            EscapeJson( this->m_path ), this->m_error.empty(), EscapeJson( this->m_error ), this->m_threadsCount,
+                            this->m_entitiesCount, this->m_meshesCount, this->m_trianglesCount, this->m_polylinesCount, this->m_geometryBytes,
+                            this->m_gpuBytes, this->m_processPeakBytes, this->m_loadMilliseconds, this->m_deduplicateMilliseconds,
+                            this->m_consolidateMilliseconds, this->m_linesMilliseconds, this->m_cacheMilliseconds, this->m_glbMilliseconds,
+                            this->m_totalMilliseconds );
+    }
+};
+
+// Settings of a batch run. The thread budget is split into filesCount files processed at once, each of them
+// gets threadsCount / filesCount threads for its own parallel phases.
+class BatchOptions {
+public:
+    int m_threadsCount = (int)std::max( std::thread::hardware_concurrency(), 1u );
+    int m_filesCount = 0;
+    // Directory for the stats files, empty to write them next to the IFC files
+    std::string m_outputDirectory;
+    // Writes the geometry cache next to every IFC file, so the viewer opens it without processing
+    bool m_writeCache = false;
+    // Writes every file as binary glTF next to its stats file, the threads of the file are used for the export
+    bool m_writeGlb = false;
+    GlbOptions m_glbOptions;
+    std::function<ModelCacheKey( const std::string& )> m_createCacheKey;
+
+    [[nodiscard]] inline int GetFilesCount() const {
+        // Without a setting every file gets up to 4 threads, small files don't scale further
+        return std::max( this->m_filesCount > 0 ? this->m_filesCount : this->m_threadsCount / 4, 1 );
+    }
+    [[nodiscard]] inline int GetThreadsPerFile() const {
+        return std::max( this->m_threadsCount / this->GetFilesCount(), 1 );
+    }
+};
+
+// IFC files of a directory and its subdirectories, or the paths listed line by line in a text file. The
+// root is the directory the stats paths are made relative to.
+inline std::vector<std::filesystem::path> CollectIfcFiles( const std::filesystem::path& input, std::filesystem::path* root ) {
+    auto isIfcFile = []( const std::filesystem::path& path ) {
+        auto extension = path.extension().string();
+        std::transform( extension.begin(), extension.end(), extension.begin(), []( unsigned char c ) { return (char)std::tolower( c ); } );
+        return extension == ".ifc";
+    };
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    if( std::filesystem::is_directory( input, error ) ) {
+        *root = input;
+        for( const auto& entry: std::filesystem::recursive_directory_iterator( input, std::filesystem::directory_options::skip_permission_denied, error ) ) {
+            if( entry.is_regular_file( error ) && isIfcFile( entry.path() ) ) {
+                files.push_back( entry.path() );
+            }
+        }
+        std::sort( files.begin(), files.end() );
+    } else if( isIfcFile( input ) ) {
+        files.push_back( input );
+    } else {
+        std::ifstream list( input );
+        std::string line;
+        while( std::getline( list, line ) ) {
+            line.erase( line.find_last_not_of( " \t\r" ) + 1 );
+            if( !line.empty() ) {
+                files.emplace_back( line );
+            }
+        }
+    }
+    return files;
+}
+
+// Loads the file and runs every step of SendToGpu which doesn't need OpenGL, measuring each phase. The GLB file is
+// written to outputPath + ".glb".
+inline BatchFileStats ProcessIfcFile( const std::filesystem::path& path, const std::filesystem::path& outputPath,
+                                      const std::shared_ptr<ifcpp::Parameters>& parameters, const BatchOptions& options ) {
+    TRACE_SCOPE( "ProcessIfcFile" );
+    BatchFileStats stats;
+    stats.m_path = path.string();
+    stats.m_threadsCount = options.GetThreadsPerFile();
+    const auto startTime = std::chrono::high_resolution_clock::now();
+    auto phaseStartTime = startTime;
+    auto finishPhase = [ & ]( double* milliseconds ) {
+        const auto now = std::chrono::high_resolution_clock::now();
+        *milliseconds = std::chrono::duration<double, std::milli>( now - phaseStartTime ).count();
+        phaseStartTime = now;
+    };
+
+    try {
+        // Lets the OS read the file ahead of ifcpp's stream, see LoadModel in main.cpp
+        const MappedFile input( stats.m_path );
+        input.Advise( MappedFile::Access::WILL_NEED );
+        const auto loadStart = Tracer::Get().BeginLoad();
+        const auto entities = ifcpp::LoadModel<Adapter>( stats.m_path, parameters );
+        Tracer::Get().EndLoad( loadStart );
+        finishPhase( &stats.m_loadMilliseconds );
+        DeduplicateMeshes( entities );
+        finishPhase( &stats.m_deduplicateMilliseconds );
+
+        std::unordered_set<const void*> countedGeometries;
+        for( const auto& e: entities ) {
+            stats.m_meshesCount += e->m_meshes.size();
+            stats.m_polylinesCount += e->m_polylines.size();
+            for( const auto& m: e->m_meshes ) {
+                const auto& polygons = m->IsInstance() ? *m->m_sharedPolygons : m->m_polygons;
+                for( const auto& p: polygons ) {
+                    stats.m_trianglesCount += p.vertices.size() >= 3 ? p.vertices.size() - 2 : 0;
+                }
+                if( countedGeometries.insert( &polygons ).second ) {
+                    stats.m_geometryBytes += polygons.capacity() * sizeof( csg::Polygon );
+                    for( const auto& p: polygons ) {
+                        stats.m_geometryBytes += p.vertices.capacity() * sizeof( csg::Vector );
+                    }
+                }
+            }
+        }
+        stats.m_entitiesCount = entities.size();
+
+        const auto model = ConsolidateMeshes( entities );
+        finishPhase( &stats.m_consolidateMilliseconds );
+        LineStripsBuilder linesBuilder;
+        MetadataTable metadata;
+        for( const auto& e: entities ) {
+            for( const auto& p: e->m_polylines ) {
+                linesBuilder.Add( *p );
+            }
+            if( options.m_writeCache ) {
+                metadata.Add( e->m_metadata );
+            }
+        }
+        const auto lines = linesBuilder.Build();
+        finishPhase( &stats.m_linesMilliseconds );
+
+        const auto gpuModel = GpuModel::FromModel( model, lines, metadata );
+        for( const auto bytes: { gpuModel.m_vertices.size_bytes(), gpuModel.m_indices.size_bytes(), gpuModel.m_instances.size_bytes(),
+                                 gpuModel.m_lineVertices.size_bytes(), gpuModel.m_lineColors.size_bytes(), gpuModel.m_lineIndices.size_bytes() } ) {
+            stats.m_gpuBytes += bytes;
+        }
+        if( options.m_writeCache && options.m_createCacheKey ) {
+            ModelCache( stats.m_path + ".geometry", options.m_createCacheKey( stats.m_path ).m_hash ).Save( gpuModel );
+        }
+        finishPhase( &stats.m_cacheMilliseconds );
+        if( options.m_writeGlb ) {
+            auto glbOptions = options.m_glbOptions;
+            glbOptions.m_threadsCount = options.GetThreadsPerFile();
+            if( !ExportGlb( entities, outputPath.string() + ".glb", glbOptions ) ) {
+                stats.m_error = "the GLB file couldn't be written";
+            }
+        }
+        finishPhase( &stats.m_glbMilliseconds );
+    } catch( const std::exception& e ) {
+        stats.m_error = e.what();
+    } catch( ... ) {
+        stats.m_error = "unknown error";
+    }
+
+    stats.m_totalMilliseconds = std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - startTime ).count();
+#ifndef _WIN32
+    struct rusage usage;
+    if( getrusage( RUSAGE_SELF, &usage ) == 0 ) {
+        // Kilobytes on Linux
+        stats.m_processPeakBytes = (size_t)usage.ru_maxrss * 1024;
+    }
+#endif
+    return stats;
+}
+
+// Processes the files on options.GetFilesCount() threads and writes the stats of every file. Returns the number
+// of files which failed.
+inline int RunBatch( const std::vector<std::filesystem::path>& files, const std::filesystem::path& root,
+                     const std::shared_ptr<ifcpp::Parameters>& parameters, const BatchOptions& options ) {
+    consolidationThreadsCount = options.GetThreadsPerFile();
+    spdlog::info( "batch: {} files, {} at once with {} threads each", files.size(), options.GetFilesCount(), options.GetThreadsPerFile() );
+
+    const auto startTime = std::chrono::high_resolution_clock::now();
+    std::atomic<size_t> nextFile = 0;
+    std::atomic<int> failedCount = 0;
+    auto worker = [ & ]() {
+        for( size_t i = nextFile++; i < files.size(); i = nextFile++ ) {
+            std::filesystem::path outputPath = files[ i ];
+            if( !options.m_outputDirectory.empty() ) {
+                // Files of the same name in different directories keep their relative paths
+                std::error_code error;
+                auto relativePath = root.empty() ? files[ i ].filename() : std::filesystem::relative( files[ i ], root, error );
+                if( error || relativePath.empty() ) {
+                    relativePath = files[ i ].filename();
+                }
+                outputPath = std::filesystem::path( options.m_outputDirectory ) / relativePath;
+                std::filesystem::create_directories( outputPath.parent_path(), error );
+            }
+            const auto stats = ProcessIfcFile( files[ i ], outputPath, parameters, options );
+            std::ofstream( outputPath.string() + ".stats.json" ) << stats.ToJson();
+
+            if( stats.m_error.empty() ) {
+                spdlog::info( "[{}/{}] {}: {} entities, {} triangles in {:.0f} milliseconds", i + 1, files.size(), stats.m_path, stats.m_entitiesCount,
+                              stats.m_trianglesCount, stats.m_totalMilliseconds );
+            } else {
+                failedCount++;
+                spdlog::error( "[{}/{}] {}: {}", i + 1, files.size(), stats.m_path, stats.m_error );
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for( int t = 1; t < options.GetFilesCount(); t++ ) {
+        threads.emplace_back( worker );
+    }
+    worker();
+    for( auto& t: threads ) {
+        t.join();
+    }
+
+    const auto seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+    spdlog::info( "batch finished: {} files in {:.1f} seconds ({:.2f} files per second), {} failed", files.size(), seconds,
+                  (double)files.size() / std::max( seconds, 1e-9 ), failedCount.load() );
+    return failedCount;
+}
+
+};
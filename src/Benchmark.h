@@ -0,0 +1,363 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include <ifcpp/ModelLoader.h>
+#include "Adapter.h"
+#include "Engine.h"
+#include "MappedFile.h"
+#include "StepIndex.h"
+
+
+namespace IfcppExample {
+
+
+// Loads the same model on 1..maxThreads threads at once and logs the throughput, which shows how well
+// the adapter and its allocations scale with the number of concurrent geometry workers. With compareAllocators
+// every row is repeated with the thread arenas bypassed, which is the std::allocator baseline.
+inline void BenchmarkThreadScaling( const std::string& filePath, const std::shared_ptr<ifcpp::Parameters>& parameters, int maxThreads,
+                                    bool compareAllocators = false ) {
+    auto runLoads = [ & ]( int threadsCount ) {
+        const auto startTime = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for( int i = 0; i < threadsCount; i++ ) {
+            threads.emplace_back( [ & ]() { ifcpp::LoadModel<Adapter>( filePath, parameters ); } );
+        }
+        for( auto& t: threads ) {
+            t.join();
+        }
+        return std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+    };
+
+    const bool wasArenaUsed = useThreadArena;
+    double singleThreadSeconds[ 2 ] = {};
+    for( int threadsCount = 1; threadsCount <= maxThreads; threadsCount++ ) {
+        for( const bool isArenaUsed: { true, false } ) {
+            if( !isArenaUsed && !compareAllocators ) {
+                continue;
+            }
+            useThreadArena = isArenaUsed;
+            const auto seconds = runLoads( threadsCount );
+            if( threadsCount == 1 ) {
+                singleThreadSeconds[ isArenaUsed ] = seconds;
+            }
+            spdlog::info( "{} threads, {}: {:.3f} seconds, {:.2f} models per second, efficiency {:.0f}%", threadsCount,
+                          isArenaUsed ? "thread arenas" : "default allocator", seconds, threadsCount / seconds,
+                          100.0 * singleThreadSeconds[ isArenaUsed ] / seconds );
+        }
+    }
+    useThreadArena = wasArenaUsed;
+}
+
+// Separates reading the IFC file from tokenizing it: reads it through a stream and through a mapping, splits
+// the DATA section into instances on 1..hardware threads, and compares both with the whole ifcpp load. The first
+// read includes the disk unless the file is in the page cache already.
+inline void BenchmarkInput( const std::string& filePath, const std::shared_ptr<ifcpp::Parameters>& parameters ) {
+    auto secondsSince = []( auto startTime ) { return std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count(); };
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    const MappedFile file( filePath );
+    if( !file.IsOpen() ) {
+        spdlog::error( "Can't map {}", filePath );
+        return;
+    }
+    file.Advise( MappedFile::Access::SEQUENTIAL );
+    const auto data = file.GetData();
+    // Reading one byte of every page faults the whole file in
+    [[maybe_unused]] volatile std::byte touched;
+    for( size_t i = 0; i < data.size(); i += 4096 ) {
+        touched = data[ i ];
+    }
+    const auto mappingSeconds = secondsSince( startTime );
+    const double megabytes = (double)data.size() / ( 1 << 20 );
+
+    startTime = std::chrono::high_resolution_clock::now();
+    std::ifstream stream( filePath, std::ios::binary );
+    std::vector<char> buffer( data.size() );
+    stream.read( buffer.data(), (std::streamsize)buffer.size() );
+    const auto streamSeconds = secondsSince( startTime );
+    buffer = {};
+    spdlog::info( "{:.1f} MB: mapped and touched in {:.3f} seconds ({:.0f} MB/s), read through a stream in {:.3f} seconds ({:.0f} MB/s)", megabytes,
+                  mappingSeconds, megabytes / mappingSeconds, streamSeconds, megabytes / streamSeconds );
+
+    double singleThreadSeconds = 0;
+    size_t instancesCount = 0;
+    const int maxThreads = (int)std::max( std::thread::hardware_concurrency(), 1u );
+    for( int threadsCount = 1; threadsCount <= maxThreads; threadsCount *= 2 ) {
+        startTime = std::chrono::high_resolution_clock::now();
+        const auto index = StepIndex::Build( data, threadsCount );
+        const auto seconds = secondsSince( startTime );
+        if( threadsCount == 1 ) {
+            singleThreadSeconds = seconds;
+            instancesCount = index.m_instances.size();
+        } else if( index.m_instances.size() != instancesCount ) {
+            spdlog::error( "{} threads found {} instances instead of {}", threadsCount, index.m_instances.size(), instancesCount );
+        }
+        spdlog::info( "tokenized {} instances on {} threads in {:.3f} seconds ({:.0f} MB/s), speedup {:.2f}", index.m_instances.size(), threadsCount,
+                      seconds, megabytes / seconds, singleThreadSeconds / seconds );
+    }
+
+    startTime = std::chrono::high_resolution_clock::now();
+    const auto entities = ifcpp::LoadModel<Adapter>( filePath, parameters );
+    const auto loadSeconds = secondsSince( startTime );
+    spdlog::info( "ifcpp load (parsing and geometry, {} entities): {:.3f} seconds, reading the file is {:.1f}% of it, tokenizing on one thread {:.1f}%",
+                  entities.size(), loadSeconds, 100 * std::min( mappingSeconds, streamSeconds ) / loadSeconds, 100 * singleThreadSeconds / loadSeconds );
+}
+
+// Triangulates star-shaped profiles of 4 to 10000 vertices on a tilted plane, alone and with a hole,
+// and logs the time per call, which should grow roughly linearly with the number of vertices
+inline void BenchmarkTriangulation() {
+    Adapter adapter;
+    const csg::Vector right = csg::Normalized( csg::Vector( 1, 0, 1 ) );
+    const csg::Vector up = csg::Normalized( csg::Vector( 0, 1, 0.5 ) );
+    auto createLoop = [ & ]( int verticesCount, double radius, bool isClockwise ) {
+        std::vector<csg::Vector> loop;
+        for( int i = 0; i < verticesCount; i++ ) {
+            const double angle = ( isClockwise ? -2 : 2 ) * M_PI * i / verticesCount;
+            const double r = radius * ( 1 + 0.1 * std::sin( 7.0 * angle ) );
+            loop.push_back( right * ( r * std::cos( angle ) ) + up * ( r * std::sin( angle ) ) );
+        }
+        return loop;
+    };
+
+    for( int verticesCount: { 4, 16, 64, 256, 1024, 4096, 10000 } ) {
+        const auto outer = createLoop( verticesCount, 10, false );
+        const std::vector<std::vector<csg::Vector>> loops = { outer, createLoop( std::max( verticesCount / 4, 3 ), 2, true ) };
+        const int iterations = std::max( 200000 / verticesCount, 5 );
+
+        size_t indicesCount = 0;
+        size_t holeIndicesCount = 0;
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for( int i = 0; i < iterations; i++ ) {
+            indicesCount += adapter.Triangulate( outer ).size();
+        }
+        const auto outerSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+        startTime = std::chrono::high_resolution_clock::now();
+        for( int i = 0; i < iterations; i++ ) {
+            holeIndicesCount += adapter.Triangulate( loops ).size();
+        }
+        const auto holeSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+
+        spdlog::info( "{} vertices: {:.2f} us per loop ({:.1f} ns per vertex, {} triangles), {:.2f} us with a hole ({} triangles)", verticesCount,
+                      1e6 * outerSeconds / iterations, 1e9 * outerSeconds / iterations / verticesCount, indicesCount / 3 / iterations,
+                      1e6 * holeSeconds / iterations, holeIndicesCount / 3 / iterations );
+    }
+}
+
+// Triangulates a mix of face loops with and without the convex fast path. The mix approximates the loop shapes
+// seen when loading architectural models: mostly rectangles from walls, slabs and extrusion sides, then triangles
+// of tessellated faces, small convex polygons, circles of round profiles, concave L and U profiles and faces
+// with openings. Logs the share of loops taken by the fast path and the time per loop.
+inline void BenchmarkLoopShapes() {
+    struct Shape {
+        const char* m_name;
+        int m_percent;
+        std::vector<std::vector<csg::Vector>> m_loops;
+    };
+    const csg::Vector right = csg::Normalized( csg::Vector( 1, 0, 1 ) );
+    const csg::Vector up = csg::Normalized( csg::Vector( 0, 1, 0.5 ) );
+    auto createLoop = [ & ]( const std::vector<std::array<double, 2>>& points ) {
+        std::vector<csg::Vector> loop;
+        for( const auto& p: points ) {
+            loop.push_back( right * p[ 0 ] + up * p[ 1 ] );
+        }
+        return loop;
+    };
+    auto createCircle = [ & ]( int verticesCount, double radius, bool isClockwise ) {
+        std::vector<std::array<double, 2>> points;
+        for( int i = 0; i < verticesCount; i++ ) {
+            const double angle = ( isClockwise ? -2 : 2 ) * M_PI * i / verticesCount;
+            points.push_back( { radius * std::cos( angle ), radius * std::sin( angle ) } );
+        }
+        return createLoop( points );
+    };
+    const std::vector<Shape> shapes = {
+        { "rectangles", 55, { createLoop( { { 0, 0 }, { 4, 0 }, { 4, 3 }, { 0, 3 } } ) } },
+        { "triangles", 15, { createLoop( { { 0, 0 }, { 1, 0 }, { 0.3, 0.8 } } ) } },
+        { "convex 5-8", 10, { createCircle( 6, 1, false ) } },
+        { "circles 16-64", 8, { createCircle( 32, 1, false ) } },
+        { "concave", 7, { createLoop( { { 0, 0 }, { 3, 0 }, { 3, 2 }, { 2, 2 }, { 2, 1 }, { 1, 1 }, { 1, 2 }, { 0, 2 } } ) } },
+        { "with holes", 5, { createCircle( 8, 3, false ), createCircle( 8, 1, true ) } },
+    };
+    std::vector<const Shape*> mix;
+    for( const auto& s: shapes ) {
+        mix.insert( mix.end(), s.m_percent, &s );
+    }
+
+    Adapter adapter;
+    const int iterations = 20000;
+    double seconds[ 2 ];
+    size_t indicesCounts[ 2 ] = { 0, 0 };
+    for( int isFastPath = 0; isFastPath < 2; isFastPath++ ) {
+        triangulationFastPath = isFastPath;
+        const auto startTime = std::chrono::high_resolution_clock::now();
+        for( int i = 0; i < iterations; i++ ) {
+            for( const auto* s: mix ) {
+                indicesCounts[ isFastPath ] += adapter.Triangulate( s->m_loops ).size();
+            }
+        }
+        seconds[ isFastPath ] = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+    }
+    triangulationFastPath = true;
+
+    // The classifier is protected, Triangulate doesn't tell which path was taken
+    struct Classifier: Adapter {
+        using Adapter::TriangulateConvex;
+    };
+    int fastPathPercent = 0;
+    for( const auto& s: shapes ) {
+        std::vector<int> indices;
+        if( s.m_loops.size() == 1 && Classifier::TriangulateConvex( s.m_loops[ 0 ], *PlaneFrame::FromLoop( s.m_loops[ 0 ] ), &indices ) ) {
+            fastPathPercent += s.m_percent;
+        }
+    }
+    const auto loopsCount = (double)iterations * mix.size();
+    spdlog::info( "{}% of the loops take the fast path", fastPathPercent );
+    spdlog::info( "earcut only: {:.1f} ns per loop, with the fast path: {:.1f} ns per loop ({:.2f}x), {} / {} triangles", 1e9 * seconds[ 0 ] / loopsCount,
+                  1e9 * seconds[ 1 ] / loopsCount, seconds[ 0 ] / seconds[ 1 ], indicesCounts[ 0 ] / 3 / iterations, indicesCounts[ 1 ] / 3 / iterations );
+}
+
+// Triangulates large profiles, a smooth star like a curved slab and a jagged outline like a site boundary,
+// each with a hole, using the scalar and the batched earcut kernels. Logs both times and whether the
+// triangles are the same.
+inline void BenchmarkEarcutKernels() {
+    std::mt19937 random( 1 );
+    std::uniform_real_distribution<double> jitter( 0.8, 1.2 );
+    for( const bool isJagged: { false, true } ) {
+        for( const int verticesCount: { 1000, 5000, 20000, 50000 } ) {
+            std::vector<std::vector<std::array<double, 2>>> polygon( 2 );
+            for( int i = 0; i < verticesCount; i++ ) {
+                const double angle = 2 * M_PI * i / verticesCount;
+                const double r = 100 * ( isJagged ? jitter( random ) : 1 + 0.1 * std::sin( 7 * angle ) );
+                polygon[ 0 ].push_back( { r * std::cos( angle ), r * std::sin( angle ) } );
+            }
+            const int holeVerticesCount = verticesCount / 10;
+            for( int i = 0; i < holeVerticesCount; i++ ) {
+                const double angle = -2 * M_PI * i / holeVerticesCount;
+                polygon[ 1 ].push_back( { 20 * std::cos( angle ), 20 * std::sin( angle ) } );
+            }
+
+            mapbox::detail::Earcut<int> earcut;
+            const int iterations = std::max( 200000 / verticesCount, 3 );
+            double seconds[ 2 ];
+            std::vector<int> indices[ 2 ];
+            for( int isBatched = 0; isBatched < 2; isBatched++ ) {
+                earcut.batched = isBatched;
+                const auto startTime = std::chrono::high_resolution_clock::now();
+                for( int i = 0; i < iterations; i++ ) {
+                    earcut( polygon );
+                }
+                seconds[ isBatched ] = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count() / iterations;
+                indices[ isBatched ] = earcut.indices;
+            }
+            spdlog::info( "{} {} vertices: scalar {:.2f} ms, batched {:.2f} ms ({:.2f}x), {} triangles, {}", isJagged ? "jagged" : "smooth",
+                          verticesCount, 1e3 * seconds[ 0 ], 1e3 * seconds[ 1 ], seconds[ 0 ] / seconds[ 1 ], indices[ 0 ].size() / 3,
+                          indices[ 0 ] == indices[ 1 ] ? "same result" : "DIFFERENT RESULT" );
+        }
+    }
+}
+
+// Calls of the global operator new on the calling thread, counted by the replacement operator in main.cpp
+inline thread_local size_t heapAllocationsCount = 0;
+
+// Builds the same entity, a mesh of 1000 triangles and a polyline of 100 points, through the copying and the
+// moving factory overloads of Adapter. Logs the allocations per entity and whether the triangle and point
+// buffers handed to the factories ended up in the entity without being copied. Arena allocations are the
+// vertex lists, meshes, polylines and entities of ArenaAllocator and MakeShared. Heap allocations are all
+// calls of the global operator new, e.g. the std::vector buffers of triangle and point lists and the blocks
+// which refill the arena.
+inline void BenchmarkAllocations() {
+    Adapter adapter;
+    const int trianglesCount = 1000;
+    const int pointsCount = 100;
+    std::vector<csg::Vector> vertices;
+    for( int i = 0; i <= trianglesCount / 2; i++ ) {
+        vertices.emplace_back( i, 0, 0 );
+        vertices.emplace_back( i, 1, 0 );
+    }
+
+    for( bool isMoving: { false, true } ) {
+        const auto startCount = ThreadArena::GetAllocationsCount();
+        const auto startHeapCount = heapAllocationsCount;
+        std::vector<Adapter::TTriangle> triangles;
+        triangles.reserve( trianglesCount );
+        for( int i = 0; i < trianglesCount / 2; i++ ) {
+            triangles.push_back( adapter.CreateTriangle( vertices, { 2 * i, 2 * i + 2, 2 * i + 1 } ) );
+            triangles.push_back( adapter.CreateTriangle( vertices, { 2 * i + 1, 2 * i + 2, 2 * i + 3 } ) );
+        }
+        const auto trianglesAllocationsCount = ThreadArena::GetAllocationsCount() - startCount;
+        const auto trianglesHeapAllocationsCount = heapAllocationsCount - startHeapCount;
+        std::vector<csg::Vector> points( vertices.begin(), vertices.begin() + pointsCount );
+        const void* trianglesData = triangles.data();
+        const void* pointsData = points.data();
+
+        const auto entityStartCount = ThreadArena::GetAllocationsCount();
+        const auto entityStartHeapCount = heapAllocationsCount;
+        std::vector<Adapter::TMesh> meshes;
+        std::vector<Adapter::TPolyline> polylines;
+        Adapter::TEntity entity;
+        if( isMoving ) {
+            meshes.push_back( adapter.CreateMesh( std::move( triangles ) ) );
+            polylines.push_back( adapter.CreatePolyline( std::move( points ) ) );
+            entity = adapter.CreateEntity( nullptr, std::move( meshes ), std::move( polylines ) );
+        } else {
+            meshes.push_back( adapter.CreateMesh( triangles ) );
+            polylines.push_back( adapter.CreatePolyline( points ) );
+            entity = adapter.CreateEntity( nullptr, meshes, polylines );
+        }
+        const auto entityAllocationsCount = ThreadArena::GetAllocationsCount() - entityStartCount;
+        const auto entityHeapAllocationsCount = heapAllocationsCount - entityStartHeapCount;
+        const bool isZeroCopy = entity->m_meshes[ 0 ]->m_sharedPolygons->data() == trianglesData && entity->m_polylines[ 0 ]->m_points.data() == pointsData;
+        spdlog::info( "{} factories: {} arena and {} heap allocations for {} triangles, {} arena and {} heap allocations for the mesh, polyline "
+                      "and entity, buffers {}",
+                      isMoving ? "moving" : "copying", trianglesAllocationsCount, trianglesHeapAllocationsCount, trianglesCount, entityAllocationsCount,
+                      entityHeapAllocationsCount, isZeroCopy ? "moved" : "copied" );
+    }
+}
+
+// Renders the uploaded model from the model center and from 1, 4 and 16 model radii away, with and without
+// detail levels, and logs the drawn triangles and the frame time. The frames are finished before timing, so
+// the result doesn't depend on the swap interval.
+inline void BenchmarkRendering( int framesCount ) {
+    glm::vec3 center( 0 );
+    for( const auto& b: entityBounds ) {
+        center += glm::vec3( b[ 0 ], b[ 1 ], b[ 2 ] );
+    }
+    center /= (float)std::max<size_t>( entityBounds.size(), 1 );
+    float radius = 0;
+    for( const auto& b: entityBounds ) {
+        radius = std::max( radius, glm::length( glm::vec3( b[ 0 ], b[ 1 ], b[ 2 ] ) - center ) + b[ 3 ] );
+    }
+
+    int width, height;
+    glfwGetFramebufferSize( window, &width, &height );
+    horizontalAngle = 0;
+    verticalAngle = 0;
+    Update();
+    for( float distance: { 0.0f, 1.0f, 4.0f, 16.0f } ) {
+        cameraPosition = center - viewDir * distance * radius;
+        for( bool isLodEnabled: { false, true } ) {
+            lodEnabled = isLodEnabled;
+            Render( width, height );
+            glFinish();
+            const auto startTime = std::chrono::high_resolution_clock::now();
+            for( int i = 0; i < framesCount; i++ ) {
+                Render( width, height );
+                glFinish();
+            }
+            const auto seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - startTime ).count();
+            spdlog::info( "{} model radii away, detail levels {}: {} triangles, {:.3f} ms per frame", distance, isLodEnabled ? "on" : "off",
+                          drawnTrianglesCount, 1e3 * seconds / framesCount );
+        }
+    }
+    lodEnabled = true;
+}
+
+};
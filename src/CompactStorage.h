@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "IndexedAdapter.h"
+
+
+namespace IfcppExample {
+
+
+enum class StoragePrecision {
+    // 32-bit floats relative to the center of the entity bounding box
+    FLOAT32,
+    // 16-bit integers spanning the entity bounding box
+    QUANTIZED16
+};
+
+// Indexed triangles of a finished entity, only one of the position arrays is used depending on the precision
+class CompactMesh {
+public:
+    std::vector<float> m_positions;
+    std::vector<uint16_t> m_quantizedPositions;
+    std::vector<uint32_t> m_indices;
+    unsigned int m_color = 0;
+};
+
+// Entity whose geometry won't be modified anymore, stored with reduced precision. Vertex coordinates are
+// decoded as m_origin + position * m_step, the decode parameters are shared by all meshes of the entity.
+class CompactEntity {
+public:
+    std::shared_ptr<IFC4X3::IfcObjectDefinition> m_ifcObject;
+    StoragePrecision m_precision = StoragePrecision::FLOAT32;
+    csg::Vector m_origin;
+    std::array<double, 3> m_step { 1, 1, 1 };
+    std::vector<CompactMesh> m_meshes;
+    std::vector<std::shared_ptr<Polyline>> m_polylines;
+    EntityMetadata m_metadata;
+
+    [[nodiscard]] inline size_t GetVerticesCount( const CompactMesh& mesh ) const {
+        return ( this->m_precision == StoragePrecision::FLOAT32 ? mesh.m_positions.size() : mesh.m_quantizedPositions.size() ) / 3;
+    }
+
+    [[nodiscard]] inline csg::Vector GetVertex( const CompactMesh& mesh, size_t i ) const {
+        if( this->m_precision == StoragePrecision::FLOAT32 ) {
+            const auto p = &mesh.m_positions[ i * 3 ];
+            return { this->m_origin.x + p[ 0 ], this->m_origin.y + p[ 1 ], this->m_origin.z + p[ 2 ] };
+        }
+        const auto q = &mesh.m_quantizedPositions[ i * 3 ];
+        return { this->m_origin.x + q[ 0 ] * this->m_step[ 0 ], this->m_origin.y + q[ 1 ] * this->m_step[ 1 ], this->m_origin.z + q[ 2 ] * this->m_step[ 2 ] };
+    }
+
+    [[nodiscard]] inline size_t GetBytes() const {
+        size_t bytes = sizeof( CompactEntity );
+        for( const auto& m: this->m_meshes ) {
+            bytes += sizeof( CompactMesh ) + m.m_positions.capacity() * sizeof( float ) + m.m_quantizedPositions.capacity() * sizeof( uint16_t ) +
+                m.m_indices.capacity() * sizeof( uint32_t );
+        }
+        return bytes;
+    }
+};
+
+// Geometry shared by several meshes is only counted for the first one, counted holds the geometry seen so far
+inline size_t GetMeshBytes( const Mesh& mesh, std::unordered_set<const void*>* counted ) {
+    size_t bytes = sizeof( Mesh );
+    const auto& polygons = mesh.IsInstance() ? *mesh.m_sharedPolygons : mesh.m_polygons;
+    if( counted->insert( &polygons ).second ) {
+        bytes += polygons.capacity() * sizeof( csg::Polygon );
+        for( const auto& p: polygons ) {
+            bytes += p.vertices.capacity() * sizeof( csg::Vector );
+        }
+    }
+    return bytes;
+}
+
+inline size_t GetMeshBytes( const IndexedMesh& mesh, std::unordered_set<const void*>* counted ) {
+    return counted->insert( &mesh ).second ? sizeof( IndexedMesh ) + mesh.GetBytes() : 0;
+}
+
+// Converts a finished entity of Adapter or IndexedAdapter to compact storage
+template<typename TEntity>
+std::shared_ptr<CompactEntity> MakeCompactEntity( const TEntity& e, StoragePrecision precision ) {
+    auto entity = std::make_shared<CompactEntity>();
+    entity->m_ifcObject = e.m_ifcObject;
+    entity->m_precision = precision;
+    entity->m_polylines = e.m_polylines;
+    entity->m_metadata = e.m_metadata;
+
+    // Polygon meshes are welded into indexed form first
+    std::vector<IndexedMesh> storage;
+    std::vector<csg::Polygon> polygons;
+    std::vector<const IndexedMesh*> meshes;
+    storage.reserve( e.m_meshes.size() );
+    for( const auto& m: e.m_meshes ) {
+        if constexpr( std::is_same_v<TEntity, IndexedEntity> ) {
+            meshes.push_back( m.get() );
+        } else {
+            meshes.push_back( &storage.emplace_back( IndexedMesh::FromPolygons( m->GetPolygons( &polygons ), m->m_color ) ) );
+        }
+    }
+
+    std::array<double, 3> min, max;
+    min.fill( std::numeric_limits<double>::max() );
+    max.fill( -std::numeric_limits<double>::max() );
+    for( const auto m: meshes ) {
+        for( const auto& v: m->m_vertices ) {
+            min = { std::min( min[ 0 ], v.x ), std::min( min[ 1 ], v.y ), std::min( min[ 2 ], v.z ) };
+            max = { std::max( max[ 0 ], v.x ), std::max( max[ 1 ], v.y ), std::max( max[ 2 ], v.z ) };
+        }
+    }
+    if( min[ 0 ] <= max[ 0 ] ) {
+        if( precision == StoragePrecision::FLOAT32 ) {
+            entity->m_origin = csg::Vector( ( min[ 0 ] + max[ 0 ] ) / 2, ( min[ 1 ] + max[ 1 ] ) / 2, ( min[ 2 ] + max[ 2 ] ) / 2 );
+        } else {
+            entity->m_origin = csg::Vector( min[ 0 ], min[ 1 ], min[ 2 ] );
+            for( int a = 0; a < 3; a++ ) {
+                entity->m_step[ a ] = max[ a ] > min[ a ] ? ( max[ a ] - min[ a ] ) / std::numeric_limits<uint16_t>::max() : 1;
+            }
+        }
+    }
+
+    const double origin[ 3 ] = { entity->m_origin.x, entity->m_origin.y, entity->m_origin.z };
+    for( const auto m: meshes ) {
+        auto& compact = entity->m_meshes.emplace_back();
+        compact.m_color = m->m_color;
+        compact.m_indices = m->m_indices;
+        for( const auto& v: m->m_vertices ) {
+            const double p[ 3 ] = { v.x, v.y, v.z };
+            for( int a = 0; a < 3; a++ ) {
+                if( precision == StoragePrecision::FLOAT32 ) {
+                    compact.m_positions.push_back( (float)( p[ a ] - origin[ a ] ) );
+                } else {
+                    compact.m_quantizedPositions.push_back( (uint16_t)std::lround( ( p[ a ] - origin[ a ] ) / entity->m_step[ a ] ) );
+                }
+            }
+        }
+    }
+    return entity;
+}
+
+// Converts finished entities of Adapter or IndexedAdapter to compact storage, for callers which keep the
+// entities after loading. Shared geometry is expanded into every instance, so a model with many instances can
+// take more memory than before, the logged sizes show it.
+template<typename TEntity>
+std::vector<std::shared_ptr<CompactEntity>> CompactEntities( const std::vector<std::shared_ptr<TEntity>>& entities, StoragePrecision precision ) {
+    std::vector<std::shared_ptr<CompactEntity>> result;
+    result.reserve( entities.size() );
+    std::unordered_set<const void*> counted;
+    size_t sourceBytes = 0;
+    size_t compactBytes = 0;
+    for( const auto& e: entities ) {
+        for( const auto& m: e->m_meshes ) {
+            sourceBytes += GetMeshBytes( *m, &counted );
+        }
+        auto entity = MakeCompactEntity( *e, precision );
+        compactBytes += entity->GetBytes();
+        result.push_back( std::move( entity ) );
+    }
+    spdlog::info( "compact geometry storage: {} KB, {} KB before", compactBytes / 1024, sourceBytes / 1024 );
+    return result;
+}
+};
@@ -0,0 +1,543 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "CompactStorage.h"
+#include "IndexedAdapter.h"
+#include "Simplification.h"
+
+
+namespace IfcppExample {
+
+
+// Number of threads which prepare the bucket geometry, 0 uses all hardware threads
+inline int consolidationThreadsCount = 0;
+
+// Triangles of one material, drawn with a constant color. m_firstIndex and m_indicesCount cover the full detail
+// geometry, the entity ranges of the bucket are m_firstRange .. m_firstRange + m_rangesCount - 1 of m_bucketRanges.
+struct MaterialBucket {
+    unsigned int m_color;
+    int m_firstIndex;
+    int m_indicesCount;
+    int m_firstRange;
+    int m_rangesCount;
+};
+
+struct IndexRange {
+    int m_firstIndex;
+    int m_indicesCount;
+};
+
+// Triangles of one entity inside a material bucket, for every detail level starting with the full geometry.
+// Levels which weren't simplified point to the range of the previous level.
+struct EntityRange {
+    int m_entity;
+    int m_bucket;
+    std::array<IndexRange, MAX_LOD_LEVELS> m_lods;
+};
+
+struct Instance {
+    float m_transform[ 12 ];
+    unsigned int m_color;
+};
+
+// Range of the index buffer drawn once for each instance in a range of the instance buffer
+struct InstanceGroup {
+    int m_firstIndex;
+    int m_indicesCount;
+    int m_firstInstance;
+    int m_instancesCount;
+    bool m_isTransparent;
+};
+
+// Geometry of all entities in one vertex and one index buffer. Meshes are grouped by color across entities,
+// opaque buckets come first, and inside a bucket the triangles of every entity are contiguous. The simplified
+// levels follow the full detail buckets in the index buffer and use the same vertices.
+class ConsolidatedModel {
+public:
+    std::vector<float> m_vertices;
+    std::vector<unsigned int> m_indices;
+    std::vector<MaterialBucket> m_buckets;
+    int m_firstTransparentBucket = 0;
+    int m_lodLevelsCount = 1;
+    // Ranges of entity i are m_entityRanges[ m_entityRangesStart[ i ] ] .. m_entityRanges[ m_entityRangesStart[ i + 1 ] - 1 ]
+    std::vector<EntityRange> m_entityRanges;
+    std::vector<int> m_entityRangesStart;
+    // The same ranges ordered by bucket, for drawing
+    std::vector<EntityRange> m_bucketRanges;
+    // Bounding sphere of every entity as center x, y, z and radius, used to choose its detail level
+    std::vector<std::array<float, 4>> m_entityBounds;
+    // Geometry shared by several meshes is stored once and drawn per instance
+    std::vector<Instance> m_instances;
+    std::vector<int> m_instanceEntities;
+    std::vector<InstanceGroup> m_instanceGroups;
+    csg::Vector m_center;
+
+    [[nodiscard]] inline std::span<const EntityRange> GetEntityRanges( size_t entityIndex ) const {
+        return { this->m_entityRanges.data() + this->m_entityRangesStart[ entityIndex ],
+                 this->m_entityRanges.data() + this->m_entityRangesStart[ entityIndex + 1 ] };
+    }
+};
+
+inline bool IsTransparent( unsigned int color ) {
+    return ( color >> 24 ) != 255;
+}
+
+// Fills a ConsolidatedModel: geometry is collected into per-color buckets, which are then written out opaque first
+class ModelBuilder {
+public:
+    ConsolidatedModel m_model;
+    size_t m_meshesCount = 0;
+
+    explicit ModelBuilder( size_t entitiesCount )
+        : m_entitiesCount( entitiesCount ) {
+    }
+
+    struct CompactGeometry {
+        const CompactEntity* m_entity;
+        const CompactMesh* m_mesh;
+    };
+    using Geometry = std::variant<const std::vector<csg::Polygon>*, const IndexedMesh*, CompactGeometry>;
+
+    // Geometry is referenced until BuildBuckets
+    inline void Add( int entity, unsigned int color, Geometry geometry ) {
+        auto [ it, isInserted ] = this->m_bucketIndices.try_emplace( color, (int)this->m_bucketColors.size() );
+        if( isInserted ) {
+            this->m_bucketColors.push_back( color );
+            this->m_bucketItems.emplace_back();
+        }
+        this->m_bucketItems[ it->second ].push_back( { entity, geometry } );
+        this->m_meshesCount++;
+    }
+
+    // Appends geometry to the buffers, isWorld is false for the local coordinates of instanced geometry
+    inline void Append( const std::vector<csg::Polygon>& polygons, bool isWorld = true ) {
+        for( const auto& p: polygons ) {
+            const auto firstVertex = (unsigned int)( this->m_model.m_vertices.size() / 3 );
+            for( int i = 1; i < p.vertices.size() - 1; i++ ) {
+                this->m_model.m_indices.push_back( firstVertex );
+                this->m_model.m_indices.push_back( i + firstVertex );
+                this->m_model.m_indices.push_back( i + 1 + firstVertex );
+            }
+            for( const auto& v: p.vertices ) {
+                this->AppendVertex( v, isWorld );
+            }
+        }
+    }
+    inline void Append( const IndexedMesh& mesh, bool isWorld = true ) {
+        const auto firstVertex = (unsigned int)( this->m_model.m_vertices.size() / 3 );
+        for( const auto i: mesh.m_indices ) {
+            this->m_model.m_indices.push_back( firstVertex + i );
+        }
+        for( const auto& v: mesh.m_vertices ) {
+            this->AppendVertex( v, isWorld );
+        }
+    }
+
+    // Adds count vertices with the given sum to the center of the model
+    inline void AddToCenter( const csg::Vector& sum, size_t count ) {
+        this->m_centerSum = this->m_centerSum + sum;
+        this->m_centerVerticesCount += count;
+    }
+
+    // Writes the buckets and the entity ranges, must be called before instanced geometry is appended
+    inline void BuildBuckets() {
+        std::vector<int> bucketOrder( this->m_bucketColors.size() );
+        for( int b = 0; b < bucketOrder.size(); b++ ) {
+            bucketOrder[ b ] = b;
+        }
+        std::sort( bucketOrder.begin(), bucketOrder.end(), [ & ]( int a, int b ) {
+            const auto ca = this->m_bucketColors[ a ], cb = this->m_bucketColors[ b ];
+            return IsTransparent( ca ) != IsTransparent( cb ) ? !IsTransparent( ca ) : ca < cb;
+        } );
+
+        auto& model = this->m_model;
+        model.m_lodLevelsCount = std::clamp( lodLevelsCount, 1, MAX_LOD_LEVELS );
+        const auto lodStartTime = std::chrono::high_resolution_clock::now();
+        auto prepared = this->PrepareItems( bucketOrder, model.m_lodLevelsCount );
+        const auto lodMilliseconds =
+            std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::high_resolution_clock::now() - lodStartTime ).count();
+
+        std::vector<std::array<float, 3>> boundsMin( this->m_entitiesCount, std::array<float, 3> { 1, 1, 1 } );
+        std::vector<std::array<float, 3>> boundsMax( this->m_entitiesCount, std::array<float, 3> { -1, -1, -1 } );
+        // Simplified levels are collected per level and appended after all full detail buckets
+        std::array<std::vector<unsigned int>, MAX_LOD_LEVELS> lodIndices;
+        std::vector<bool> isSimplified;
+        auto& ranges = model.m_bucketRanges;
+        size_t p = 0;
+        for( int b: bucketOrder ) {
+            const int bucket = (int)model.m_buckets.size();
+            if( !IsTransparent( this->m_bucketColors[ b ] ) ) {
+                model.m_firstTransparentBucket = bucket + 1;
+            }
+            model.m_buckets.push_back( { this->m_bucketColors[ b ], (int)model.m_indices.size(), 0, (int)ranges.size(), 0 } );
+            for( const auto& item: this->m_bucketItems[ b ] ) {
+                const auto& geometry = prepared[ p++ ];
+                if( ranges.empty() || ranges.back().m_entity != item.m_entity || ranges.back().m_bucket != bucket ) {
+                    this->FinishRange( &lodIndices, isSimplified.empty() || isSimplified.back() );
+                    EntityRange range { item.m_entity, bucket, {} };
+                    range.m_lods[ 0 ].m_firstIndex = (int)model.m_indices.size();
+                    for( int l = 1; l < model.m_lodLevelsCount; l++ ) {
+                        range.m_lods[ l ].m_firstIndex = (int)lodIndices[ l ].size();
+                    }
+                    ranges.push_back( range );
+                    isSimplified.push_back( false );
+                }
+
+                const auto firstIndex = model.m_indices.size();
+                const auto firstVertex = (unsigned int)( model.m_vertices.size() / 3 );
+                this->Append( *geometry.m_mesh );
+                auto& min = boundsMin[ item.m_entity ];
+                auto& max = boundsMax[ item.m_entity ];
+                for( size_t i = firstVertex * 3; i < model.m_vertices.size(); i += 3 ) {
+                    if( min[ 0 ] > max[ 0 ] ) {
+                        min = max = { model.m_vertices[ i ], model.m_vertices[ i + 1 ], model.m_vertices[ i + 2 ] };
+                    }
+                    for( int a = 0; a < 3; a++ ) {
+                        min[ a ] = std::min( min[ a ], model.m_vertices[ i + a ] );
+                        max[ a ] = std::max( max[ a ], model.m_vertices[ i + a ] );
+                    }
+                }
+                for( int l = 1; l < model.m_lodLevelsCount; l++ ) {
+                    if( geometry.m_lods[ l ].empty() ) {
+                        // Not simplified, the level repeats the full geometry in case other meshes of the range are simplified
+                        lodIndices[ l ].insert( lodIndices[ l ].end(), model.m_indices.begin() + firstIndex, model.m_indices.end() );
+                    } else {
+                        for( const auto i: geometry.m_lods[ l ] ) {
+                            lodIndices[ l ].push_back( firstVertex + i );
+                        }
+                        isSimplified.back() = true;
+                    }
+                }
+                auto& range = ranges.back();
+                range.m_lods[ 0 ].m_indicesCount = (int)model.m_indices.size() - range.m_lods[ 0 ].m_firstIndex;
+                for( int l = 1; l < model.m_lodLevelsCount; l++ ) {
+                    range.m_lods[ l ].m_indicesCount = (int)lodIndices[ l ].size() - range.m_lods[ l ].m_firstIndex;
+                }
+            }
+            model.m_buckets.back().m_indicesCount = (int)model.m_indices.size() - model.m_buckets.back().m_firstIndex;
+            model.m_buckets.back().m_rangesCount = (int)ranges.size() - model.m_buckets.back().m_firstRange;
+        }
+        this->FinishRange( &lodIndices, isSimplified.empty() || isSimplified.back() );
+
+        for( int l = 1; l < model.m_lodLevelsCount; l++ ) {
+            const auto offset = (int)model.m_indices.size();
+            model.m_indices.insert( model.m_indices.end(), lodIndices[ l ].begin(), lodIndices[ l ].end() );
+            for( size_t r = 0; r < ranges.size(); r++ ) {
+                if( isSimplified[ r ] ) {
+                    ranges[ r ].m_lods[ l ].m_firstIndex += offset;
+                }
+            }
+        }
+        std::array<size_t, MAX_LOD_LEVELS> trianglesCounts {};
+        for( auto& range: ranges ) {
+            for( int l = model.m_lodLevelsCount; l < MAX_LOD_LEVELS; l++ ) {
+                range.m_lods[ l ] = range.m_lods[ l - 1 ];
+            }
+            for( int l = 0; l < MAX_LOD_LEVELS; l++ ) {
+                trianglesCounts[ l ] += range.m_lods[ l ].m_indicesCount / 3;
+            }
+        }
+        if( model.m_lodLevelsCount > 1 ) {
+            spdlog::info( "detail levels: {} / {} / {} triangles, simplified in {} milliseconds", trianglesCounts[ 0 ], trianglesCounts[ 1 ],
+                          trianglesCounts[ 2 ], lodMilliseconds );
+        }
+
+        model.m_entityBounds.assign( this->m_entitiesCount, std::array<float, 4> { 0, 0, 0, 0 } );
+        for( size_t e = 0; e < this->m_entitiesCount; e++ ) {
+            const auto& min = boundsMin[ e ];
+            const auto& max = boundsMax[ e ];
+            if( min[ 0 ] <= max[ 0 ] ) {
+                const float size[ 3 ] = { max[ 0 ] - min[ 0 ], max[ 1 ] - min[ 1 ], max[ 2 ] - min[ 2 ] };
+                model.m_entityBounds[ e ] = { ( min[ 0 ] + max[ 0 ] ) / 2, ( min[ 1 ] + max[ 1 ] ) / 2, ( min[ 2 ] + max[ 2 ] ) / 2,
+                                              std::sqrt( size[ 0 ] * size[ 0 ] + size[ 1 ] * size[ 1 ] + size[ 2 ] * size[ 2 ] ) / 2 };
+            }
+        }
+
+        model.m_entityRangesStart.assign( this->m_entitiesCount + 1, 0 );
+        for( const auto& range: ranges ) {
+            model.m_entityRangesStart[ range.m_entity + 1 ]++;
+        }
+        for( size_t e = 0; e < this->m_entitiesCount; e++ ) {
+            model.m_entityRangesStart[ e + 1 ] += model.m_entityRangesStart[ e ];
+        }
+        model.m_entityRanges.resize( ranges.size() );
+        auto next = model.m_entityRangesStart;
+        for( const auto& range: ranges ) {
+            model.m_entityRanges[ next[ range.m_entity ]++ ] = range;
+        }
+    }
+
+    inline ConsolidatedModel Finish() {
+        const auto count = (double)std::max<size_t>( this->m_centerVerticesCount, 1 );
+        this->m_model.m_center = this->m_centerSum / count;
+        spdlog::info( "{} meshes in {} material buckets ({} transparent), {} KB of per-vertex colors saved", this->m_meshesCount,
+                      this->m_model.m_buckets.size(), this->m_model.m_buckets.size() - this->m_model.m_firstTransparentBucket,
+                      this->m_model.m_vertices.size() / 3 * sizeof( unsigned int ) / 1024 );
+        return std::move( this->m_model );
+    }
+
+private:
+    struct Item {
+        int m_entity;
+        Geometry m_geometry;
+    };
+
+    size_t m_entitiesCount;
+    std::unordered_map<unsigned int, int> m_bucketIndices;
+    std::vector<unsigned int> m_bucketColors;
+    std::vector<std::vector<Item>> m_bucketItems;
+    csg::Vector m_centerSum;
+    size_t m_centerVerticesCount = 0;
+
+    // Bucket item welded into indexed form, with the simplified triangles of every level above 0
+    struct PreparedItem {
+        IndexedMesh m_storage;
+        const IndexedMesh* m_mesh = nullptr;
+        std::array<std::vector<uint32_t>, MAX_LOD_LEVELS> m_lods;
+    };
+
+    // Converts the items of all buckets in the given order and simplifies them, spread over consolidationThreadsCount threads
+    inline std::vector<PreparedItem> PrepareItems( const std::vector<int>& bucketOrder, int levelsCount ) const {
+        std::vector<const Item*> items;
+        for( int b: bucketOrder ) {
+            for( const auto& item: this->m_bucketItems[ b ] ) {
+                items.push_back( &item );
+            }
+        }
+        std::vector<PreparedItem> prepared( items.size() );
+        std::atomic<size_t> nextItem = 0;
+        auto worker = [ & ]() {
+            for( size_t i = nextItem++; i < items.size(); i = nextItem++ ) {
+                auto& result = prepared[ i ];
+                std::visit( [ & ]( const auto& geometry ) {
+                    using TGeometry = std::decay_t<decltype( geometry )>;
+                    if constexpr( std::is_same_v<TGeometry, const IndexedMesh*> ) {
+                        result.m_mesh = geometry;
+                    } else if constexpr( std::is_same_v<TGeometry, CompactGeometry> ) {
+                        const auto count = geometry.m_entity->GetVerticesCount( *geometry.m_mesh );
+                        for( size_t v = 0; v < count; v++ ) {
+                            result.m_storage.m_vertices.push_back( geometry.m_entity->GetVertex( *geometry.m_mesh, v ) );
+                        }
+                        result.m_storage.m_indices = geometry.m_mesh->m_indices;
+                        result.m_mesh = &result.m_storage;
+                    } else {
+                        result.m_storage = IndexedMesh::FromPolygons( *geometry );
+                        result.m_mesh = &result.m_storage;
+                    }
+                }, items[ i ]->m_geometry );
+
+                const auto trianglesCount = result.m_mesh->m_indices.size() / 3;
+                if( levelsCount < 2 || trianglesCount < MIN_LOD_TRIANGLES ) {
+                    continue;
+                }
+                MeshSimplifier simplifier( *result.m_mesh );
+                for( int l = 1; l < levelsCount; l++ ) {
+                    result.m_lods[ l ] = simplifier.Simplify( (size_t)( (double)trianglesCount * LOD_TRIANGLE_RATIOS[ l ] ) );
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        const int threadsCount = consolidationThreadsCount > 0 ? consolidationThreadsCount : (int)std::thread::hardware_concurrency();
+        for( int t = 1; t < threadsCount; t++ ) {
+            threads.emplace_back( worker );
+        }
+        worker();
+        for( auto& t: threads ) {
+            t.join();
+        }
+        return prepared;
+    }
+
+    // Called when the last entity range is complete: if none of its meshes were simplified, the copies of the
+    // full geometry are dropped and the levels point to the full detail range
+    inline void FinishRange( std::array<std::vector<unsigned int>, MAX_LOD_LEVELS>* lodIndices, bool isSimplified ) {
+        auto& ranges = this->m_model.m_bucketRanges;
+        if( ranges.empty() || isSimplified ) {
+            return;
+        }
+        auto& range = ranges.back();
+        for( int l = 1; l < this->m_model.m_lodLevelsCount; l++ ) {
+            ( *lodIndices )[ l ].resize( range.m_lods[ l ].m_firstIndex );
+            range.m_lods[ l ] = range.m_lods[ 0 ];
+        }
+    }
+
+    inline void AppendVertex( const csg::Vector& v, bool isWorld ) {
+        if( isWorld ) {
+            this->AddToCenter( v, 1 );
+        }
+        this->m_model.m_vertices.push_back( (float)v.x );
+        this->m_model.m_vertices.push_back( (float)v.y );
+        this->m_model.m_vertices.push_back( (float)v.z );
+    }
+};
+
+inline ConsolidatedModel ConsolidateMeshes( const std::vector<std::shared_ptr<Entity>>& entities ) {
+    TRACE_SCOPE( "ConsolidateMeshes" );
+    ModelBuilder builder( entities.size() );
+    auto& model = builder.m_model;
+    // Sizes of the geometry as stored and as it would be without sharing, for the memory report
+    size_t polygonBytes = 0;
+    size_t expandedPolygonBytes = 0;
+    size_t expandedUploadBytes = 0;
+    size_t prototypeUploadBytes = 0;
+
+    auto getPolygonBytes = []( const std::vector<csg::Polygon>& polygons ) {
+        size_t bytes = polygons.capacity() * sizeof( csg::Polygon );
+        for( const auto& p: polygons ) {
+            bytes += p.vertices.capacity() * sizeof( csg::Vector );
+        }
+        return bytes;
+    };
+
+    // Geometry used once is expanded like any other mesh, repeated geometry is kept once in local coordinates
+    std::unordered_map<const std::vector<csg::Polygon>*, std::vector<std::pair<int, const Mesh*>>> prototypes;
+    for( int e = 0; e < entities.size(); e++ ) {
+        for( const auto& m: entities[ e ]->m_meshes ) {
+            if( m->m_color != 0 && m->IsInstance() ) {
+                prototypes[ m->m_sharedPolygons.get() ].push_back( { e, m.get() } );
+            }
+        }
+    }
+
+    std::deque<std::vector<csg::Polygon>> expandedPolygons;
+    for( int e = 0; e < entities.size(); e++ ) {
+        for( const auto& m: entities[ e ]->m_meshes ) {
+            if( m->m_color == 0 ) {
+                // No material
+                continue;
+            }
+            const std::vector<csg::Polygon>* polygons = &m->m_polygons;
+            if( m->IsInstance() ) {
+                if( prototypes[ m->m_sharedPolygons.get() ].size() > 1 ) {
+                    continue;
+                }
+                polygons = m->m_instanceTransform.IsIdentity() ? m->m_sharedPolygons.get() : &expandedPolygons.emplace_back( m->CopyPolygons() );
+            } else {
+                polygonBytes += getPolygonBytes( *polygons );
+                expandedPolygonBytes += getPolygonBytes( *polygons );
+            }
+            builder.Add( e, m->m_color, polygons );
+        }
+    }
+    builder.BuildBuckets();
+
+    // Repeated geometry is drawn with one instance per mesh, transparent instances follow the opaque ones
+    std::vector<Instance> transparentInstances;
+    std::vector<int> transparentInstanceEntities;
+    std::vector<InstanceGroup> transparentGroups;
+    size_t sharedMeshesCount = 0;
+    for( const auto& [ polygons, meshes ]: prototypes ) {
+        const auto bytes = getPolygonBytes( *polygons );
+        polygonBytes += bytes;
+        expandedPolygonBytes += bytes * meshes.size();
+        if( meshes.size() < 2 ) {
+            continue;
+        }
+
+        const int firstIndex = (int)model.m_indices.size();
+        const auto firstVertex = model.m_vertices.size() / 3;
+        builder.Append( *polygons, false );
+        const int indicesCount = (int)model.m_indices.size() - firstIndex;
+        const auto verticesCount = model.m_vertices.size() / 3 - firstVertex;
+        const auto geometryBytes = verticesCount * 3 * sizeof( float ) + indicesCount * sizeof( unsigned int );
+        prototypeUploadBytes += geometryBytes;
+        sharedMeshesCount++;
+
+        // Sum of the transformed vertices is L * sum + count * t
+        csg::Vector sum( 0, 0, 0 );
+        for( const auto& p: *polygons ) {
+            for( const auto& v: p.vertices ) {
+                sum = sum + v;
+            }
+        }
+        const auto average = verticesCount > 0 ? sum / (double)verticesCount : sum;
+
+        InstanceGroup opaqueGroup { firstIndex, indicesCount, (int)model.m_instances.size(), 0, false };
+        InstanceGroup transparentGroup { firstIndex, indicesCount, (int)transparentInstances.size(), 0, true };
+        for( const auto& [ e, m ]: meshes ) {
+            const bool isTransparent = IsTransparent( m->m_color );
+            Instance instance {};
+            std::copy( m->m_instanceTransform.m_data.begin(), m->m_instanceTransform.m_data.end(), instance.m_transform );
+            instance.m_color = m->m_color;
+            ( isTransparent ? transparentInstances : model.m_instances ).push_back( instance );
+            ( isTransparent ? transparentInstanceEntities : model.m_instanceEntities ).push_back( e );
+            ( isTransparent ? transparentGroup : opaqueGroup ).m_instancesCount++;
+
+            builder.AddToCenter( m->m_instanceTransform.Apply( average ) * (double)verticesCount, verticesCount );
+            expandedUploadBytes += geometryBytes;
+            builder.m_meshesCount++;
+        }
+        for( const auto& g: { opaqueGroup, transparentGroup } ) {
+            if( g.m_instancesCount > 0 ) {
+                ( g.m_isTransparent ? transparentGroups : model.m_instanceGroups ).push_back( g );
+            }
+        }
+    }
+    for( auto& g: transparentGroups ) {
+        g.m_firstInstance += (int)model.m_instances.size();
+        model.m_instanceGroups.push_back( g );
+    }
+    std::copy( transparentInstances.begin(), transparentInstances.end(), std::back_inserter( model.m_instances ) );
+    std::copy( transparentInstanceEntities.begin(), transparentInstanceEntities.end(), std::back_inserter( model.m_instanceEntities ) );
+
+    const size_t uploadBytes = model.m_vertices.size() * sizeof( float ) + model.m_indices.size() * sizeof( unsigned int ) +
+                               model.m_instances.size() * sizeof( Instance );
+    expandedUploadBytes += uploadBytes - model.m_instances.size() * sizeof( Instance ) - prototypeUploadBytes;
+    spdlog::info( "{} instances of {} shared meshes", model.m_instances.size(), sharedMeshesCount );
+    spdlog::info( "Mesh geometry: {} KB in memory, {} KB without sharing", polygonBytes / 1024, expandedPolygonBytes / 1024 );
+    spdlog::info( "Uploaded to gpu: {} KB, {} KB without instancing", uploadBytes / 1024, expandedUploadBytes / 1024 );
+    return builder.Finish();
+}
+
+inline ConsolidatedModel ConsolidateMeshes( const std::vector<std::shared_ptr<IndexedEntity>>& entities ) {
+    TRACE_SCOPE( "ConsolidateMeshes" );
+    ModelBuilder builder( entities.size() );
+    size_t meshBytes = 0;
+    for( int e = 0; e < entities.size(); e++ ) {
+        for( const auto& m: entities[ e ]->m_meshes ) {
+            if( m->m_color == 0 ) {
+                // No material
+                continue;
+            }
+            meshBytes += m->GetBytes();
+            builder.Add( e, m->m_color, m.get() );
+        }
+    }
+    builder.BuildBuckets();
+
+    const auto& model = builder.m_model;
+    spdlog::info( "Mesh geometry: {} KB in memory", meshBytes / 1024 );
+    spdlog::info( "Uploaded to gpu: {} KB", ( model.m_vertices.size() * sizeof( float ) + model.m_indices.size() * sizeof( unsigned int ) ) / 1024 );
+    return builder.Finish();
+}
+
+inline ConsolidatedModel ConsolidateMeshes( const std::vector<std::shared_ptr<CompactEntity>>& entities ) {
+    TRACE_SCOPE( "ConsolidateMeshes" );
+    ModelBuilder builder( entities.size() );
+    for( int e = 0; e < entities.size(); e++ ) {
+        for( const auto& m: entities[ e ]->m_meshes ) {
+            if( m.m_color == 0 ) {
+                // No material
+                continue;
+            }
+            builder.Add( e, m.m_color, ModelBuilder::CompactGeometry { entities[ e ].get(), &m } );
+        }
+    }
+    builder.BuildBuckets();
+    return builder.Finish();
+}
+
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "Adapter.h"
+
+
+namespace IfcppExample {
+
+
+// Meshes whose vertices differ by no more than this after removing the translation are considered identical
+constexpr double DEDUPLICATION_TOLERANCE = 1e-6;
+
+// Post-load pass which finds meshes with the same color and the same geometry up to a translation, e.g. stacked
+// slabs or copied families which don't use mapped items. Duplicates become instances of one shared copy of the
+// polygons, which the renderer then draws instanced. Meshes whose geometry is already shared with another mesh
+// (repeated mapped items) are left as they are.
+inline void DeduplicateMeshes( const std::vector<std::shared_ptr<Entity>>& entities ) {
+    TRACE_SCOPE( "DeduplicateMeshes" );
+    // Adapter keeps the polygons of every mesh in a shared list, the ones no other mesh uses are taken back into
+    // their mesh and compared like any other geometry
+    std::unordered_map<const std::vector<csg::Polygon>*, size_t> uses;
+    for( const auto& e: entities ) {
+        for( const auto& m: e->m_meshes ) {
+            if( m->IsInstance() ) {
+                uses[ m->m_sharedPolygons.get() ]++;
+            }
+        }
+    }
+    for( const auto& e: entities ) {
+        for( const auto& m: e->m_meshes ) {
+            if( m->IsInstance() && uses[ m->m_sharedPolygons.get() ] == 1 ) {
+                m->Materialize();
+            }
+        }
+    }
+
+    auto getMin = []( const std::vector<csg::Polygon>& polygons ) {
+        csg::Vector min( std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() );
+        for( const auto& p: polygons ) {
+            for( const auto& v: p.vertices ) {
+                min = csg::Vector( std::min( min.x, v.x ), std::min( min.y, v.y ), std::min( min.z, v.z ) );
+            }
+        }
+        return min;
+    };
+    // Positions relative to the bounding box minimum, quantized to the tolerance
+    auto getHash = []( const Mesh& mesh, const csg::Vector& min ) {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [ & ]( uint64_t value ) { hash = ( hash ^ value ) * 1099511628211ull; };
+        add( mesh.m_color );
+        for( const auto& p: mesh.m_polygons ) {
+            add( p.vertices.size() );
+            for( const auto& v: p.vertices ) {
+                add( (uint64_t)std::llround( ( v.x - min.x ) / DEDUPLICATION_TOLERANCE ) );
+                add( (uint64_t)std::llround( ( v.y - min.y ) / DEDUPLICATION_TOLERANCE ) );
+                add( (uint64_t)std::llround( ( v.z - min.z ) / DEDUPLICATION_TOLERANCE ) );
+            }
+        }
+        return hash;
+    };
+    auto isSame = []( const std::vector<csg::Polygon>& a, const csg::Vector& minA, const std::vector<csg::Polygon>& b, const csg::Vector& minB ) {
+        if( a.size() != b.size() ) {
+            return false;
+        }
+        const auto offset = minB - minA;
+        for( size_t i = 0; i < a.size(); i++ ) {
+            const auto& pa = a[ i ].vertices;
+            const auto& pb = b[ i ].vertices;
+            if( pa.size() != pb.size() ) {
+                return false;
+            }
+            for( size_t j = 0; j < pa.size(); j++ ) {
+                const auto d = pb[ j ] - pa[ j ] - offset;
+                if( std::fabs( d.x ) > DEDUPLICATION_TOLERANCE || std::fabs( d.y ) > DEDUPLICATION_TOLERANCE || std::fabs( d.z ) > DEDUPLICATION_TOLERANCE ) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+    auto getBytes = []( const std::vector<csg::Polygon>& polygons ) {
+        size_t bytes = polygons.capacity() * sizeof( csg::Polygon );
+        for( const auto& p: polygons ) {
+            bytes += p.vertices.capacity() * sizeof( csg::Vector );
+        }
+        return bytes;
+    };
+
+    struct Candidate {
+        Mesh* m_mesh;
+        csg::Vector m_min;
+    };
+    std::unordered_multimap<uint64_t, Candidate> candidates;
+    size_t duplicatesCount = 0;
+    size_t sharedCount = 0;
+    size_t savedBytes = 0;
+    size_t totalBytes = 0;
+    for( const auto& e: entities ) {
+        for( const auto& m: e->m_meshes ) {
+            if( m->IsInstance() || m->m_polygons.empty() ) {
+                continue;
+            }
+            totalBytes += getBytes( m->m_polygons );
+            const auto min = getMin( m->m_polygons );
+            const auto hash = getHash( *m, min );
+
+            Candidate* original = nullptr;
+            auto [ from, to ] = candidates.equal_range( hash );
+            for( auto it = from; it != to; ++it ) {
+                const auto& c = it->second;
+                if( c.m_mesh->m_color != m->m_color ) {
+                    continue;
+                }
+                // Shared polygons are stored relative to the bounding box minimum of the original
+                const bool isShared = c.m_mesh->IsInstance();
+                if( isSame( isShared ? *c.m_mesh->m_sharedPolygons : c.m_mesh->m_polygons, isShared ? csg::Vector() : c.m_min, m->m_polygons, min ) ) {
+                    original = &it->second;
+                    break;
+                }
+            }
+            if( !original ) {
+                candidates.insert( { hash, { m.get(), min } } );
+                continue;
+            }
+
+            auto& o = *original->m_mesh;
+            if( !o.IsInstance() ) {
+                // First duplicate: the original becomes an instance of its own polygons moved to the origin
+                auto polygons = std::move( o.m_polygons );
+                for( auto& p: polygons ) {
+                    for( auto& v: p.vertices ) {
+                        v = v - original->m_min;
+                    }
+                    p.plane.w -= csg::Dot( p.plane.normal, original->m_min );
+                }
+                o.m_polygons = {};
+                o.m_sharedPolygons = MakeShared<std::vector<csg::Polygon>>( std::move( polygons ) );
+                o.m_instanceTransform.m_data = { 1, 0, 0, original->m_min.x, 0, 1, 0, original->m_min.y, 0, 0, 1, original->m_min.z };
+                sharedCount++;
+            }
+            savedBytes += getBytes( m->m_polygons );
+            m->m_polygons = {};
+            m->m_sharedPolygons = o.m_sharedPolygons;
+            m->m_instanceTransform.m_data = { 1, 0, 0, min.x, 0, 1, 0, min.y, 0, 0, 1, min.z };
+            duplicatesCount++;
+        }
+    }
+    spdlog::info( "deduplication: {} meshes share {} geometries, {} KB of {} KB saved", duplicatesCount, sharedCount, savedBytes / 1024, totalBytes / 1024 );
+}
+
+};
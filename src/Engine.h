@@ -1,13 +1,24 @@
 #pragma once
 
 #include "Adapter.h"
+#include "Consolidation.h"
+#include "ModelCache.h"
+#include "Polylines.h"
+#include "Streaming.h"
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <limits>
 #include <memory>
 #include <spdlog/spdlog.h>
+#include <unordered_map>
+#include <vector>
 
 
 namespace IfcppExample {
@@ -23,6 +34,21 @@ const char* vertexSource =
     "   gl_Position = vec4( a_position, 1 );                                                                                                                \n"
     "}                                                                                                                                                      \n";
 
+// Draws shared geometry, every instance has its own color and rows of the 3x4 transformation
+const char* instancedVertexSource =
+    "#version 330                                                                                                                                           \n"
+    "layout ( location = 0 ) in vec3 a_position;                                                                                                            \n"
+    "layout ( location = 1 ) in vec4 a_instance_color;                                                                                                      \n"
+    "layout ( location = 2 ) in vec4 a_instance_row0;                                                                                                       \n"
+    "layout ( location = 3 ) in vec4 a_instance_row1;                                                                                                       \n"
+    "layout ( location = 4 ) in vec4 a_instance_row2;                                                                                                       \n"
+    "out vec4 v_vertex_color;                                                                                                                               \n"
+    "void main() {                                                                                                                                          \n"
+    "   vec4 p = vec4( a_position, 1 );                                                                                                                     \n"
+    "   v_vertex_color = a_instance_color;                                                                                                                  \n"
+    "   gl_Position = vec4( dot( a_instance_row0, p ), dot( a_instance_row1, p ), dot( a_instance_row2, p ), 1 );                                           \n"
+    "}                                                                                                                                                      \n";
+
 const char* geometrySource =
     "#version 330                                                                                                                                           \n"
     "layout ( triangles ) in;                                                                                                                               \n"
@@ -78,22 +104,37 @@ const char* linesFragmentSource =
 
 const float moveSpeed = 5;
 const float rotateViewSpeed = 2;
+// An entity is drawn with the next detail level when the radius of its bounding sphere on the screen is below
+// these sizes in pixels
+const float lodPixelThresholds[ MAX_LOD_LEVELS - 1 ] = { 40, 10 };
+// At most this many bytes of streamed geometry are uploaded per frame, so the window stays responsive while
+// the model is loaded
+const size_t streamUploadBudget = 8 << 20;
 
 GLFWwindow* window = nullptr;
 unsigned int vaoId;
 unsigned int vboId;
-unsigned int cboId;
 unsigned int iboId;
-int iboSize;
-int iboTransparentStartIdx;
+std::vector<MaterialBucket> buckets;
+int firstTransparentBucket;
+std::vector<EntityRange> bucketRanges;
+std::vector<std::array<float, 4>> entityBounds;
+int lodLevelsInBuffers = 1;
+// Detail level of every entity in the current frame
+std::vector<int> entityLods;
 unsigned int linesVboId;
 unsigned int linesCboId;
 unsigned int linesIboId;
 int linesIboSize;
+unsigned int instanceBufferId;
+std::vector<InstanceGroup> instanceGroups;
 unsigned int program;
 unsigned int linesProgram;
+unsigned int instancedProgram;
 bool wireframeMode = false;
 bool drawPolylines = true;
+bool lodEnabled = true;
+size_t drawnTrianglesCount = 0;
 
 glm::vec3 cameraPosition;
 float horizontalAngle;
@@ -103,97 +144,191 @@ glm::vec3 upDir;
 glm::vec3 rightDir;
 
 
-void SendToGpu( const std::vector<std::shared_ptr<Entity>>& entities ) {
-    glm::vec<3, double, glm::defaultp> center( 0, 0, 0 );
-    std::vector<float> vbo;
-    std::vector<unsigned int> ibo;
-    std::vector<unsigned int> iboTransparent;
-    std::vector<unsigned int> cbo;
-    std::vector<float> linesVbo;
-    std::vector<unsigned int> linesIbo;
-    std::vector<unsigned int> linesCbo;
-    for( auto& e: entities ) {
-        for( auto& m: e->m_meshes ) {
-            if( m->m_color == 0 ) {
-                // No material
-                continue;
-            }
-            bool isTransparent = ( m->m_color >> 24 ) != 255;
-            auto targetIbo = &ibo;
-            if( isTransparent ) {
-                targetIbo = &iboTransparent;
-            }
-            for( const auto& p: m->m_polygons ) {
-                for( int i = 1; i < p.vertices.size() - 1; i++ ) {
-                    targetIbo->push_back( vbo.size() / 3 );
-                    targetIbo->push_back( i + vbo.size() / 3 );
-                    targetIbo->push_back( i + 1 + vbo.size() / 3 );
-                }
-                for( const auto& v: p.vertices ) {
-                    center = center + glm::vec<3, double, glm::defaultp>( v.x, v.y, v.z );
-                    vbo.push_back( (float)v.x );
-                    vbo.push_back( (float)v.y );
-                    vbo.push_back( (float)v.z );
-                    cbo.push_back( m->m_color );
-                }
+// GPU buffer which streamed geometry is appended to. The capacity doubles when it runs out, the old contents
+// are copied on the GPU.
+class StreamBuffer {
+public:
+    unsigned int m_id = 0;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+
+    template<typename T>
+    inline void Append( GLenum target, const std::vector<T>& data ) {
+        const size_t bytes = data.size() * sizeof( T );
+        if( this->m_size + bytes > this->m_capacity ) {
+            const size_t capacity = std::max( { this->m_capacity * 2, this->m_size + bytes, (size_t)1 << 20 } );
+            unsigned int id;
+            glGenBuffers( 1, &id );
+            glBindBuffer( GL_COPY_WRITE_BUFFER, id );
+            glBufferData( GL_COPY_WRITE_BUFFER, (long)capacity, nullptr, GL_DYNAMIC_DRAW );
+            if( this->m_size > 0 ) {
+                glBindBuffer( GL_COPY_READ_BUFFER, this->m_id );
+                glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (long)this->m_size );
+                glBindBuffer( GL_COPY_READ_BUFFER, 0 );
             }
+            glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+            this->Clear();
+            this->m_id = id;
+            this->m_capacity = capacity;
         }
-        for( const auto& p: e->m_polylines ) {
-            for( int i = 1; i < p->m_points.size(); i++ ) {
-                linesIbo.push_back( i - 1 + linesVbo.size() / 3 );
-                linesIbo.push_back( i + linesVbo.size() / 3 );
-            }
-            for( const auto& v: p->m_points ) {
-                linesVbo.push_back( (float)v.x );
-                linesVbo.push_back( (float)v.y );
-                linesVbo.push_back( (float)v.z );
-                linesCbo.push_back( p->m_color );
-            }
+        glBindBuffer( target, this->m_id );
+        glBufferSubData( target, (long)this->m_size, (long)bytes, data.data() );
+        glBindBuffer( target, 0 );
+        this->m_size += bytes;
+    }
+
+    inline void Clear() {
+        glDeleteBuffers( 1, &this->m_id );
+        this->m_id = 0;
+        this->m_size = 0;
+        this->m_capacity = 0;
+    }
+};
+
+StreamBuffer streamVertices;
+StreamBuffer streamColors;
+StreamBuffer streamIndices;
+// Streamed entities taken from the queue but not uploaded yet, a heap ordered by StreamedEntity::IsUploadedBefore
+std::vector<StreamedEntity> pendingStreamedEntities;
+size_t streamedEntitiesCount = 0;
+
+// Drops the streamed geometry, e.g. when the complete model is uploaded
+void ClearStream() {
+    streamVertices.Clear();
+    streamColors.Clear();
+    streamIndices.Clear();
+    pendingStreamedEntities.clear();
+    streamedEntities.PopAll( &pendingStreamedEntities );
+    pendingStreamedEntities.clear();
+    streamedEntitiesCount = 0;
+}
+
+// Uploads entities finished since the last frame, structural and large ones first, up to streamUploadBudget
+// bytes. The camera is placed at the center of the first uploaded batch. Returns the number of uploaded entities.
+int DrainStream() {
+    TRACE_SCOPE( "DrainStream" );
+    auto isUploadedAfter = []( const StreamedEntity& a, const StreamedEntity& b ) { return b.IsUploadedBefore( a ); };
+    const auto oldPendingCount = pendingStreamedEntities.size();
+    streamedEntities.PopAll( &pendingStreamedEntities );
+    for( auto i = oldPendingCount; i < pendingStreamedEntities.size(); i++ ) {
+        std::push_heap( pendingStreamedEntities.begin(), pendingStreamedEntities.begin() + (long)i + 1, isUploadedAfter );
+    }
+
+    std::vector<float> vertices;
+    std::vector<unsigned int> colors;
+    std::vector<unsigned int> indices;
+    glm::vec3 boundsMin( std::numeric_limits<float>::max() );
+    glm::vec3 boundsMax( std::numeric_limits<float>::lowest() );
+    int count = 0;
+    size_t bytes = 0;
+    while( !pendingStreamedEntities.empty() && bytes < streamUploadBudget ) {
+        std::pop_heap( pendingStreamedEntities.begin(), pendingStreamedEntities.end(), isUploadedAfter );
+        const auto entity = std::move( pendingStreamedEntities.back() );
+        pendingStreamedEntities.pop_back();
+        const auto firstVertex = (unsigned int)( ( streamVertices.m_size / sizeof( float ) + vertices.size() ) / 3 );
+        vertices.insert( vertices.end(), entity.m_vertices.begin(), entity.m_vertices.end() );
+        colors.insert( colors.end(), entity.m_colors.begin(), entity.m_colors.end() );
+        for( const auto i: entity.m_indices ) {
+            indices.push_back( firstVertex + i );
         }
+        boundsMin = glm::min( boundsMin, glm::vec3( entity.m_min[ 0 ], entity.m_min[ 1 ], entity.m_min[ 2 ] ) );
+        boundsMax = glm::max( boundsMax, glm::vec3( entity.m_max[ 0 ], entity.m_max[ 1 ], entity.m_max[ 2 ] ) );
+        bytes += entity.GetBytes();
+        count++;
+    }
+    if( count == 0 ) {
+        return 0;
+    }
+
+    if( streamedEntitiesCount == 0 ) {
+        cameraPosition = ( boundsMin + boundsMax ) * 0.5f;
+        horizontalAngle = 0;
+        verticalAngle = 0;
     }
-    iboTransparentStartIdx = (int)ibo.size();
-    std::copy( iboTransparent.begin(), iboTransparent.end(), std::back_inserter( ibo ) );
-    iboSize = (int)ibo.size();
-    linesIboSize = (int)linesIbo.size();
+    streamVertices.Append( GL_ARRAY_BUFFER, vertices );
+    streamColors.Append( GL_ARRAY_BUFFER, colors );
+    streamIndices.Append( GL_ELEMENT_ARRAY_BUFFER, indices );
+    streamedEntitiesCount += count;
+    return count;
+}
+
 
-    center = center / ( (double)vbo.size() / 3 );
+// Uploads the buffers and replaces the draw ranges of the previously uploaded model and the streamed geometry.
+// The model is only read during the call.
+void UploadModel( const GpuModel& model, bool resetCamera = true ) {
+    TRACE_SCOPE( "UploadModel" );
+    ClearStream();
+    glm::vec<3, double, glm::defaultp> center( model.m_center.x, model.m_center.y, model.m_center.z );
+    buckets.assign( model.m_buckets.begin(), model.m_buckets.end() );
+    firstTransparentBucket = model.m_firstTransparentBucket;
+    bucketRanges.assign( model.m_bucketRanges.begin(), model.m_bucketRanges.end() );
+    entityBounds.assign( model.m_entityBounds.begin(), model.m_entityBounds.end() );
+    lodLevelsInBuffers = model.m_lodLevelsCount;
+    instanceGroups.assign( model.m_instanceGroups.begin(), model.m_instanceGroups.end() );
+    linesIboSize = (int)model.m_lineIndices.size();
 
     // Camera position
-    cameraPosition = center;
-    horizontalAngle = 0;
-    verticalAngle = 0;
+    if( resetCamera ) {
+        cameraPosition = center;
+        horizontalAngle = 0;
+        verticalAngle = 0;
+    }
 
     glDeleteBuffers( 1, &vboId );
-    glDeleteBuffers( 1, &cboId );
     glDeleteBuffers( 1, &iboId );
     glDeleteBuffers( 1, &linesVboId );
     glDeleteBuffers( 1, &linesCboId );
     glDeleteBuffers( 1, &linesIboId );
+    glDeleteBuffers( 1, &instanceBufferId );
     glGenBuffers( 1, &vboId );
-    glGenBuffers( 1, &cboId );
     glGenBuffers( 1, &iboId );
     glGenBuffers( 1, &linesVboId );
     glGenBuffers( 1, &linesCboId );
     glGenBuffers( 1, &linesIboId );
+    glGenBuffers( 1, &instanceBufferId );
 
     glBindBuffer( GL_ARRAY_BUFFER, vboId );
-    glBufferData( GL_ARRAY_BUFFER, (int)( sizeof( float ) * vbo.size() ), vbo.data(), GL_STATIC_DRAW );
-    glBindBuffer( GL_ARRAY_BUFFER, cboId );
-    glBufferData( GL_ARRAY_BUFFER, (int)( sizeof( unsigned int ) * cbo.size() ), cbo.data(), GL_STATIC_DRAW );
+    glBufferData( GL_ARRAY_BUFFER, (int)model.m_vertices.size_bytes(), model.m_vertices.data(), GL_STATIC_DRAW );
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, iboId );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, (int)( sizeof( unsigned int ) * ibo.size() ), ibo.data(), GL_STATIC_DRAW );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, (int)model.m_indices.size_bytes(), model.m_indices.data(), GL_STATIC_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER, instanceBufferId );
+    glBufferData( GL_ARRAY_BUFFER, (int)model.m_instances.size_bytes(), model.m_instances.data(), GL_STATIC_DRAW );
 
     glBindBuffer( GL_ARRAY_BUFFER, linesVboId );
-    glBufferData( GL_ARRAY_BUFFER, (int)( sizeof( float ) * linesVbo.size() ), linesVbo.data(), GL_STATIC_DRAW );
+    glBufferData( GL_ARRAY_BUFFER, (int)model.m_lineVertices.size_bytes(), model.m_lineVertices.data(), GL_STATIC_DRAW );
     glBindBuffer( GL_ARRAY_BUFFER, linesCboId );
-    glBufferData( GL_ARRAY_BUFFER, (int)( sizeof( unsigned int ) * linesCbo.size() ), linesCbo.data(), GL_STATIC_DRAW );
+    glBufferData( GL_ARRAY_BUFFER, (int)model.m_lineColors.size_bytes(), model.m_lineColors.data(), GL_STATIC_DRAW );
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, linesIboId );
-    glBufferData( GL_ELEMENT_ARRAY_BUFFER, (int)( sizeof( unsigned int ) * linesIbo.size() ), linesIbo.data(), GL_STATIC_DRAW );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, (int)model.m_lineIndices.size_bytes(), model.m_lineIndices.data(), GL_STATIC_DRAW );
 
     glBindBuffer( GL_ARRAY_BUFFER, 0 );
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
 }
 
+// Entities come from Adapter, IndexedAdapter or CompactEntities. When a cache is given, the uploaded buffers
+// are written to it as well.
+template<typename TEntity>
+void SendToGpu( const std::vector<std::shared_ptr<TEntity>>& entities, bool resetCamera = true, const ModelCache* cache = nullptr ) {
+    TRACE_SCOPE( "SendToGpu" );
+    const auto model = ConsolidateMeshes( entities );
+    LineStripsBuilder linesBuilder;
+    MetadataTable metadata;
+    for( auto& e: entities ) {
+        for( const auto& p: e->m_polylines ) {
+            linesBuilder.Add( *p );
+        }
+        if( cache ) {
+            metadata.Add( e->m_metadata );
+        }
+    }
+    const auto lines = linesBuilder.Build();
+    const auto gpuModel = GpuModel::FromModel( model, lines, metadata );
+    if( cache ) {
+        cache->Save( gpuModel );
+    }
+    UploadModel( gpuModel, resetCamera );
+}
+
 
 void InitEngine() {
     //  Create window
@@ -255,15 +390,37 @@ void InitEngine() {
         glDeleteShader( vertex );
         glDeleteShader( fragment );
     }
+    {
+        GLuint vertex = glCreateShader( GL_VERTEX_SHADER );
+        glShaderSource( vertex, 1, &instancedVertexSource, nullptr );
+        glCompileShader( vertex );
+        GLuint geometry = glCreateShader( GL_GEOMETRY_SHADER );
+        glShaderSource( geometry, 1, &geometrySource, nullptr );
+        glCompileShader( geometry );
+        GLuint fragment = glCreateShader( GL_FRAGMENT_SHADER );
+        glShaderSource( fragment, 1, &fragmentSource, nullptr );
+        glCompileShader( fragment );
+        instancedProgram = glCreateProgram();
+        glAttachShader( instancedProgram, vertex );
+        glAttachShader( instancedProgram, geometry );
+        glAttachShader( instancedProgram, fragment );
+        glLinkProgram( instancedProgram );
+        glDetachShader( instancedProgram, vertex );
+        glDetachShader( instancedProgram, geometry );
+        glDetachShader( instancedProgram, fragment );
+        glDeleteShader( geometry );
+        glDeleteShader( vertex );
+        glDeleteShader( fragment );
+    }
 
     // Create buffers
     glGenVertexArrays( 1, &vaoId );
     glGenBuffers( 1, &vboId );
-    glGenBuffers( 1, &cboId );
     glGenBuffers( 1, &iboId );
     glGenBuffers( 1, &linesVboId );
     glGenBuffers( 1, &linesCboId );
     glGenBuffers( 1, &linesIboId );
+    glGenBuffers( 1, &instanceBufferId );
 
     // Set clear color, enable depth testing and culling
     glClearColor( 0.9f, 0.9f, 0.9f, 1.0f );
@@ -280,6 +437,10 @@ void InitEngine() {
         if( key == GLFW_KEY_X && action == GLFW_PRESS ) {
             drawPolylines = !drawPolylines;
         }
+        // Set callback to key L (detail levels on/off)
+        if( key == GLFW_KEY_L && action == GLFW_PRESS ) {
+            lodEnabled = !lodEnabled;
+        }
     } );
 }
 
@@ -334,6 +495,105 @@ void Update() {
     }
 }
 
+void DrawInstances( const glm::mat4& mvp, bool isTransparent ) {
+    glUseProgram( instancedProgram );
+    glUniformMatrix4fv( glGetUniformLocation( instancedProgram, "m_transform" ), 1, GL_FALSE, glm::value_ptr( mvp ) );
+    glBindBuffer( GL_ARRAY_BUFFER, instanceBufferId );
+    for( int i = 1; i <= 4; i++ ) {
+        glEnableVertexAttribArray( i );
+        glVertexAttribDivisor( i, 1 );
+    }
+    for( const auto& g: instanceGroups ) {
+        if( g.m_isTransparent != isTransparent ) {
+            continue;
+        }
+        const auto offset = g.m_firstInstance * sizeof( Instance );
+        glVertexAttribPointer( 1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof( Instance ), (void*)( offset + offsetof( Instance, m_color ) ) );
+        for( int r = 0; r < 3; r++ ) {
+            glVertexAttribPointer( 2 + r, 4, GL_FLOAT, GL_FALSE, sizeof( Instance ), (void*)( offset + r * 4 * sizeof( float ) ) );
+        }
+        glDrawElementsInstanced( GL_TRIANGLES, g.m_indicesCount, GL_UNSIGNED_INT, (void*)( g.m_firstIndex * sizeof( unsigned int ) ), g.m_instancesCount );
+        drawnTrianglesCount += (size_t)g.m_indicesCount / 3 * g.m_instancesCount;
+    }
+    for( int i = 1; i <= 4; i++ ) {
+        glVertexAttribDivisor( i, 0 );
+    }
+    for( int i = 1; i <= 4; i++ ) {
+        glDisableVertexAttribArray( i );
+    }
+    glUseProgram( program );
+}
+
+// Chooses the detail level of every entity from the size of its bounding sphere on the screen
+void SelectLods( int height ) {
+    entityLods.assign( entityBounds.size(), 0 );
+    if( !lodEnabled || lodLevelsInBuffers < 2 ) {
+        return;
+    }
+    const float pixelsPerUnit = (float)height / 2 / std::tan( glm::radians( 60.0f ) / 2 );
+    for( size_t e = 0; e < entityBounds.size(); e++ ) {
+        const auto& bounds = entityBounds[ e ];
+        const float distance = glm::length( glm::vec3( bounds[ 0 ], bounds[ 1 ], bounds[ 2 ] ) - cameraPosition );
+        if( distance <= bounds[ 3 ] ) {
+            continue;
+        }
+        const float pixels = bounds[ 3 ] / distance * pixelsPerUnit;
+        int lod = 0;
+        while( lod + 1 < lodLevelsInBuffers && pixels < lodPixelThresholds[ lod ] ) {
+            lod++;
+        }
+        entityLods[ e ] = lod;
+    }
+}
+
+// Draws the material buckets in [from, to), the color is a constant vertex attribute set once per bucket. The
+// entity ranges at the chosen levels are drawn with one call per bucket, adjacent ranges are merged.
+void DrawBuckets( int from, int to ) {
+    static std::vector<int> counts;
+    static std::vector<const void*> offsets;
+    for( int b = from; b < to; b++ ) {
+        const auto color = buckets[ b ].m_color;
+        glVertexAttrib4f( 1, (float)( color & 0xff ) / 255.0f, (float)( ( color >> 8 ) & 0xff ) / 255.0f, (float)( ( color >> 16 ) & 0xff ) / 255.0f,
+                          (float)( color >> 24 ) / 255.0f );
+        counts.clear();
+        offsets.clear();
+        int lastIndex = -1;
+        for( int r = buckets[ b ].m_firstRange; r < buckets[ b ].m_firstRange + buckets[ b ].m_rangesCount; r++ ) {
+            const auto& range = bucketRanges[ r ].m_lods[ entityLods[ bucketRanges[ r ].m_entity ] ];
+            if( range.m_indicesCount == 0 ) {
+                continue;
+            }
+            if( range.m_firstIndex == lastIndex ) {
+                counts.back() += range.m_indicesCount;
+            } else {
+                counts.push_back( range.m_indicesCount );
+                offsets.push_back( (void*)( range.m_firstIndex * sizeof( unsigned int ) ) );
+            }
+            lastIndex = range.m_firstIndex + range.m_indicesCount;
+            drawnTrianglesCount += range.m_indicesCount / 3;
+        }
+        glMultiDrawElements( GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), (int)counts.size() );
+    }
+}
+
+// Draws the streamed geometry with per vertex colors. Opaque and transparent triangles are mixed in the stream,
+// so it is drawn with blending, which doesn't change the opaque ones.
+void DrawStream() {
+    if( streamIndices.m_size == 0 ) {
+        return;
+    }
+    glEnableVertexAttribArray( 1 );
+    glBindBuffer( GL_ARRAY_BUFFER, streamVertices.m_id );
+    glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, nullptr );
+    glBindBuffer( GL_ARRAY_BUFFER, streamColors.m_id );
+    glVertexAttribPointer( 1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, nullptr );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, streamIndices.m_id );
+    const auto indicesCount = (int)( streamIndices.m_size / sizeof( unsigned int ) );
+    glDrawElements( GL_TRIANGLES, indicesCount, GL_UNSIGNED_INT, nullptr );
+    drawnTrianglesCount += indicesCount / 3;
+    glDisableVertexAttribArray( 1 );
+}
+
 void Render( int width, int height ) {
     glViewport( 0, 0, width, height );
 
@@ -345,6 +605,8 @@ void Render( int width, int height ) {
 
     glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
     glUseProgram( program );
+    drawnTrianglesCount = 0;
+    SelectLods( height );
 
     auto projectionMatrix = glm::perspective( glm::radians( 60.0f ), (float)width / (float)height, 0.1f, 500.0f );
 
@@ -355,26 +617,23 @@ void Render( int width, int height ) {
     glUniformMatrix4fv( glGetUniformLocation( program, "m_transform" ), 1, GL_FALSE, glm::value_ptr( mvp ) );
     glBindVertexArray( vaoId );
     glEnableVertexAttribArray( 0 );
-    glEnableVertexAttribArray( 1 );
     glBindBuffer( GL_ARRAY_BUFFER, vboId );
     glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, 0, nullptr );
-    glBindBuffer( GL_ARRAY_BUFFER, cboId );
-    glVertexAttribPointer( 1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, nullptr );
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, iboId );
 
-    glDrawElements( GL_TRIANGLES, iboTransparentStartIdx, GL_UNSIGNED_INT, nullptr );
+    DrawBuckets( 0, firstTransparentBucket );
+    DrawInstances( mvp, false );
 
-    if( iboTransparentStartIdx < iboSize ) {
-        glEnable( GL_BLEND );
-        glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
-        glDrawElements( GL_TRIANGLES, iboSize - iboTransparentStartIdx, GL_UNSIGNED_INT, (void*)( iboTransparentStartIdx * sizeof( unsigned int ) ) );
-        glDisable( GL_BLEND );
-    }
+    glEnable( GL_BLEND );
+    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+    DrawBuckets( firstTransparentBucket, (int)buckets.size() );
+    DrawInstances( mvp, true );
+    DrawStream();
+    glDisable( GL_BLEND );
 
     glBindBuffer( GL_ARRAY_BUFFER, 0 );
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
     glDisableVertexAttribArray( 0 );
-    glDisableVertexAttribArray( 1 );
     glBindVertexArray( 0 );
     glUseProgram( 0 );
 
@@ -394,7 +653,10 @@ void Render( int width, int height ) {
         glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, linesIboId );
 
         glDepthFunc( GL_LEQUAL );
-        glDrawElements( GL_LINES, linesIboSize, GL_UNSIGNED_INT, nullptr );
+        glEnable( GL_PRIMITIVE_RESTART );
+        glPrimitiveRestartIndex( PRIMITIVE_RESTART_INDEX );
+        glDrawElements( GL_LINE_STRIP, linesIboSize, GL_UNSIGNED_INT, nullptr );
+        glDisable( GL_PRIMITIVE_RESTART );
         glDepthFunc( GL_LESS );
 
         glBindBuffer( GL_ARRAY_BUFFER, 0 );
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "ifcpp/Ifc/IfcBuildingStorey.h"
+#include "ifcpp/Ifc/IfcElement.h"
+#include "ifcpp/Ifc/IfcObjectDefinition.h"
+#include "ifcpp/Ifc/IfcRelAggregates.h"
+#include "ifcpp/Ifc/IfcRelContainedInSpatialStructure.h"
+
+
+namespace IfcppExample {
+
+
+// When set, entities keep only their metadata and release the IFC object, so the parsed instance graph can
+// be freed as soon as the model is loaded
+inline bool releaseIfcObjects = false;
+
+// What the viewer needs to know about the IFC object of an entity, copied out of the instance graph
+class EntityMetadata {
+public:
+    std::string m_globalId;
+    std::string m_type;
+    std::string m_name;
+    // Name of the building storey containing the object, empty if there is none
+    std::string m_storey;
+
+    static inline EntityMetadata FromIfcObject( const std::shared_ptr<IFC4X3::IfcObjectDefinition>& object ) {
+        if( !object ) {
+            return {};
+        }
+        return { object->m_GlobalId ? object->m_GlobalId->m_value : std::string(), object->className(),
+                 object->m_Name ? object->m_Name->m_value : std::string(), FindStorey( object ) };
+    }
+
+private:
+    // Elements are contained in a spatial structure element, spatial elements and element parts are aggregated
+    // into their parents, so the storey is found by walking up both relations
+    static inline std::string FindStorey( const std::shared_ptr<IFC4X3::IfcObjectDefinition>& object ) {
+        const int maxDepth = 16;
+        auto current = object;
+        for( int depth = 0; current && depth < maxDepth; depth++ ) {
+            if( auto storey = std::dynamic_pointer_cast<IFC4X3::IfcBuildingStorey>( current ) ) {
+                return storey->m_Name ? storey->m_Name->m_value : std::string();
+            }
+            std::shared_ptr<IFC4X3::IfcObjectDefinition> parent;
+            if( auto element = std::dynamic_pointer_cast<IFC4X3::IfcElement>( current ) ) {
+                for( const auto& r: element->m_ContainedInStructure_inverse ) {
+                    if( auto relation = r.lock(); relation && relation->m_RelatingStructure ) {
+                        parent = relation->m_RelatingStructure;
+                        break;
+                    }
+                }
+            }
+            if( !parent ) {
+                for( const auto& r: current->m_Decomposes_inverse ) {
+                    if( auto relation = r.lock(); relation && relation->m_RelatingObject ) {
+                        parent = relation->m_RelatingObject;
+                        break;
+                    }
+                }
+            }
+            current = parent;
+        }
+        return {};
+    }
+};
+
+};
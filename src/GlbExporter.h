@@ -0,0 +1,553 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#include "CompactStorage.h"
+#include "Json.h"
+#include "Trace.h"
+
+
+namespace IfcppExample {
+
+
+class GlbOptions {
+public:
+    // 16-bit positions spanning the entity bounding box (KHR_mesh_quantization) instead of 32-bit floats relative
+    // to its center
+    bool m_quantizePositions = false;
+    int m_threadsCount = (int)std::max( std::thread::hardware_concurrency(), 1u );
+    // Entities encoded by one task, up to m_threadsCount encoded chunks are held in memory at once
+    size_t m_chunkEntitiesCount = 256;
+};
+
+// Meshes of one color of an entity, offsets are into the bytes of the chunk. Positions are followed by the
+// indices, both padded to 4 bytes.
+struct GlbPrimitive {
+    unsigned int m_color;
+    bool m_isQuantized;
+    bool m_isShortIndices;
+    uint32_t m_verticesCount;
+    uint32_t m_indicesCount;
+    size_t m_positionsOffset;
+    size_t m_indicesOffset;
+    std::array<double, 3> m_min;
+    std::array<double, 3> m_max;
+};
+
+// Primitives of one glTF mesh and the translation and scale which decode their positions
+struct GlbGeometry {
+    std::vector<GlbPrimitive> m_primitives;
+    std::array<double, 3> m_translation {};
+    std::array<double, 3> m_scale { 1, 1, 1 };
+    bool m_isScaled = false;
+};
+
+// Mesh of a prototype (see GlbPrototypes) placed by the transformation of the instance
+struct GlbInstance {
+    size_t m_prototype;
+    AffineTransform m_transform;
+};
+
+struct GlbNode {
+    // Name and extras as JSON members, prototypes have none
+    std::string m_members;
+    GlbGeometry m_geometry;
+    std::vector<GlbInstance> m_instances;
+};
+
+// Consecutive entities encoded independently of the other chunks
+struct GlbChunk {
+    std::vector<std::byte> m_bytes;
+    std::vector<GlbNode> m_nodes;
+};
+
+template<typename T>
+inline void AppendBytes( std::vector<std::byte>* bytes, const T* values, size_t count ) {
+    static_assert( std::is_trivially_copyable_v<T> );
+    const auto size = bytes->size();
+    bytes->resize( size + count * sizeof( T ) );
+    std::memcpy( bytes->data() + size, values, count * sizeof( T ) );
+}
+
+// Meshes of the same color are merged into one primitive, meshes without a color aren't drawn by the viewer
+// and are skipped
+inline GlbGeometry EncodeGlbGeometry( const CompactEntity& entity, std::vector<std::byte>* bytes ) {
+    GlbGeometry geometry;
+    std::vector<unsigned int> colors;
+    for( const auto& m: entity.m_meshes ) {
+        if( m.m_color != 0 && !m.m_indices.empty() && std::find( colors.begin(), colors.end(), m.m_color ) == colors.end() ) {
+            colors.push_back( m.m_color );
+        }
+    }
+    const bool isQuantized = entity.m_precision == StoragePrecision::QUANTIZED16;
+    for( const auto color: colors ) {
+        GlbPrimitive primitive { color, isQuantized, false, 0, 0, bytes->size(), 0, {}, {} };
+        primitive.m_min.fill( std::numeric_limits<double>::max() );
+        primitive.m_max.fill( std::numeric_limits<double>::lowest() );
+        for( const auto& m: entity.m_meshes ) {
+            if( m.m_color != color ) {
+                continue;
+            }
+            const auto verticesCount = entity.GetVerticesCount( m );
+            if( isQuantized ) {
+                // Vertex attributes are aligned to 4 bytes
+                for( size_t v = 0; v < verticesCount; v++ ) {
+                    const uint16_t position[ 4 ] = { m.m_quantizedPositions[ v * 3 ], m.m_quantizedPositions[ v * 3 + 1 ],
+                                                     m.m_quantizedPositions[ v * 3 + 2 ], 0 };
+                    AppendBytes( bytes, position, 4 );
+                }
+            } else {
+                AppendBytes( bytes, m.m_positions.data(), m.m_positions.size() );
+            }
+            for( size_t v = 0; v < verticesCount; v++ ) {
+                for( int a = 0; a < 3; a++ ) {
+                    const double p = isQuantized ? (double)m.m_quantizedPositions[ v * 3 + a ] : (double)m.m_positions[ v * 3 + a ];
+                    primitive.m_min[ a ] = std::min( primitive.m_min[ a ], p );
+                    primitive.m_max[ a ] = std::max( primitive.m_max[ a ], p );
+                }
+            }
+            primitive.m_verticesCount += (uint32_t)verticesCount;
+        }
+
+        // 0xffff is the primitive restart index of some APIs
+        primitive.m_isShortIndices = primitive.m_verticesCount < std::numeric_limits<uint16_t>::max();
+        primitive.m_indicesOffset = bytes->size();
+        uint32_t firstVertex = 0;
+        for( const auto& m: entity.m_meshes ) {
+            if( m.m_color != color ) {
+                continue;
+            }
+            for( const auto i: m.m_indices ) {
+                if( primitive.m_isShortIndices ) {
+                    const auto index = (uint16_t)( firstVertex + i );
+                    AppendBytes( bytes, &index, 1 );
+                } else {
+                    const auto index = firstVertex + i;
+                    AppendBytes( bytes, &index, 1 );
+                }
+            }
+            firstVertex += (uint32_t)entity.GetVerticesCount( m );
+            primitive.m_indicesCount += (uint32_t)m.m_indices.size();
+        }
+        bytes->resize( ( bytes->size() + 3 ) / 4 * 4 );
+        geometry.m_primitives.push_back( primitive );
+    }
+
+    geometry.m_translation = { entity.m_origin.x, entity.m_origin.y, entity.m_origin.z };
+    if( isQuantized ) {
+        geometry.m_scale = entity.m_step;
+        geometry.m_isScaled = true;
+    }
+    return geometry;
+}
+
+// Geometry shared by several instances (see DeduplicateMeshes) is written once per color as a glTF mesh which the
+// nodes of the instances refer to, geometry used once is expanded like any other mesh
+class GlbPrototypes {
+public:
+    using Key = std::pair<const std::vector<csg::Polygon>*, unsigned int>;
+    // In the order of the first use
+    std::vector<Key> m_keys;
+
+    template<typename TEntity>
+    static inline GlbPrototypes Collect( const std::vector<std::shared_ptr<TEntity>>& entities ) {
+        GlbPrototypes prototypes;
+        if constexpr( std::is_same_v<TEntity, Entity> ) {
+            std::map<Key, size_t> uses;
+            for( const auto& e: entities ) {
+                for( const auto& m: e->m_meshes ) {
+                    if( m->m_color != 0 && m->IsInstance() && ++uses[ { m->m_sharedPolygons.get(), m->m_color } ] == 2 ) {
+                        prototypes.m_indices.emplace( Key { m->m_sharedPolygons.get(), m->m_color }, prototypes.m_keys.size() );
+                        prototypes.m_keys.push_back( { m->m_sharedPolygons.get(), m->m_color } );
+                    }
+                }
+            }
+        }
+        return prototypes;
+    }
+
+    [[nodiscard]] inline std::optional<size_t> Find( const Mesh& mesh ) const {
+        if( !mesh.IsInstance() ) {
+            return std::nullopt;
+        }
+        const auto found = this->m_indices.find( { mesh.m_sharedPolygons.get(), mesh.m_color } );
+        return found != this->m_indices.end() ? std::optional<size_t>( found->second ) : std::nullopt;
+    }
+
+private:
+    std::map<Key, size_t> m_indices;
+};
+
+// Prototypes are encoded like an entity with a single mesh in the local coordinates of the shared geometry
+inline GlbNode EncodeGlbPrototype( const GlbPrototypes::Key& key, StoragePrecision precision, std::vector<std::byte>* bytes ) {
+    const IndexedEntity entity { nullptr, { std::make_shared<IndexedMesh>( IndexedMesh::FromPolygons( *key.first, key.second ) ) }, {}, {} };
+    return GlbNode { {}, EncodeGlbGeometry( *MakeCompactEntity( entity, precision ), bytes ), {} };
+}
+
+template<typename TEntity>
+inline GlbNode EncodeGlbNode( const TEntity& entity, StoragePrecision precision, const GlbPrototypes& prototypes, std::vector<std::byte>* bytes ) {
+    const auto& metadata = entity.m_metadata;
+    GlbNode node;
+    node.m_members = fmt::format( "\"name\":\"{}\",\"extras\":{{\"type\":\"{}\",\"name\":\"{}\",\"storey\":\"{}\"}}", EscapeJson( metadata.m_globalId ),
+                                  EscapeJson( metadata.m_type ), EscapeJson( metadata.m_name ), EscapeJson( metadata.m_storey ) );
+    if constexpr( std::is_same_v<TEntity, CompactEntity> ) {
+        node.m_geometry = EncodeGlbGeometry( entity, bytes );
+    } else if constexpr( std::is_same_v<TEntity, Entity> ) {
+        // Instances of a prototype refer to its mesh, only the other meshes are encoded with the entity
+        Entity own { nullptr, {}, {}, {} };
+        for( const auto& m: entity.m_meshes ) {
+            if( const auto prototype = prototypes.Find( *m ) ) {
+                node.m_instances.push_back( { *prototype, m->m_instanceTransform } );
+            } else {
+                own.m_meshes.push_back( m );
+            }
+        }
+        node.m_geometry = EncodeGlbGeometry( *MakeCompactEntity( own, precision ), bytes );
+    } else {
+        node.m_geometry = EncodeGlbGeometry( *MakeCompactEntity( entity, precision ), bytes );
+    }
+    return node;
+}
+
+// Appends encoded chunks to a temporary binary file and collects the JSON of their nodes, Finish writes the GLB
+// file from both
+class GlbWriter {
+public:
+    explicit GlbWriter( std::string path )
+        : m_path( std::move( path ) )
+        , m_binaryPath( this->m_path + ".bin.tmp" )
+        , m_binary( this->m_binaryPath, std::ios::binary | std::ios::trunc ) {
+    }
+    GlbWriter( const GlbWriter& ) = delete;
+    GlbWriter& operator=( const GlbWriter& ) = delete;
+
+    ~GlbWriter() {
+        this->m_binary.close();
+        std::error_code error;
+        std::filesystem::remove( this->m_binaryPath, error );
+    }
+
+    // Prototypes are written as meshes without nodes, before the entities which refer to them
+    inline void AppendPrototypes( const GlbChunk& chunk ) {
+        const auto chunkOffset = this->WriteBytes( chunk );
+        for( const auto& n: chunk.m_nodes ) {
+            const auto mesh = n.m_geometry.m_primitives.empty() ? std::optional<size_t>() : this->AddMesh( n.m_geometry, chunkOffset );
+            this->m_prototypes.push_back( { mesh, n.m_geometry } );
+        }
+    }
+
+    // Entities with instances get a child node for their own geometry and one for every instance
+    inline void Append( const GlbChunk& chunk ) {
+        const auto chunkOffset = this->WriteBytes( chunk );
+        for( const auto& n: chunk.m_nodes ) {
+            const auto entityNode = this->m_nodesCount++;
+            AddSeparator( &this->m_rootChildren );
+            this->m_rootChildren += std::to_string( entityNode );
+            std::string geometry;
+            if( !n.m_geometry.m_primitives.empty() ) {
+                geometry = fmt::format( "\"mesh\":{}", this->AddMesh( n.m_geometry, chunkOffset ) ) + GetDecodingMembers( n.m_geometry );
+            }
+            // The matrix of an instance includes the decoding of the prototype positions, glTF doesn't allow it
+            // together with a translation or scale on the same node
+            std::vector<std::string> children;
+            for( const auto& i: n.m_instances ) {
+                const auto& [ mesh, prototype ] = this->m_prototypes[ i.m_prototype ];
+                if( mesh ) {
+                    children.push_back( fmt::format( "\"mesh\":{},\"matrix\":", *mesh ) + GetInstanceMatrix( i.m_transform, prototype ) );
+                    this->m_instancesCount++;
+                }
+            }
+
+            AddSeparator( &this->m_nodes );
+            this->m_nodes += "{" + n.m_members;
+            if( children.empty() ) {
+                this->m_nodes += ( geometry.empty() ? "" : "," + geometry ) + "}";
+            } else {
+                if( !geometry.empty() ) {
+                    children.insert( children.begin(), geometry );
+                }
+                this->m_nodes += ",\"children\":[";
+                for( size_t c = 0; c < children.size(); c++ ) {
+                    this->m_nodes += ( c ? "," : "" ) + std::to_string( this->m_nodesCount + c );
+                }
+                this->m_nodes += "]}";
+                for( const auto& c: children ) {
+                    this->m_nodes += ",{" + c + "}";
+                }
+                this->m_nodesCount += children.size();
+            }
+            this->m_entitiesCount++;
+        }
+    }
+
+    // Writes a temporary file next to the GLB file and renames it, like the geometry cache
+    inline bool Finish() {
+        this->m_binary.close();
+        auto json = this->BuildJson();
+        json.resize( ( json.size() + 3 ) / 4 * 4, ' ' );
+        const uint64_t length = 12 + 8 + json.size() + ( this->m_binarySize ? 8 + this->m_binarySize : 0 );
+        if( !this->m_binary || length > std::numeric_limits<uint32_t>::max() ) {
+            spdlog::warn( "glb {} couldn't be written{}", this->m_path, this->m_binary ? ", it would exceed 4 GB" : "" );
+            return false;
+        }
+
+        const auto temporaryPath = this->m_path + ".tmp";
+        {
+            std::ofstream stream( temporaryPath, std::ios::binary | std::ios::trunc );
+            const uint32_t header[ 5 ] = { 0x46546c67, 2, (uint32_t)length, (uint32_t)json.size(), 0x4e4f534a };
+            stream.write( (const char*)header, sizeof( header ) );
+            stream.write( json.data(), (std::streamsize)json.size() );
+            if( this->m_binarySize ) {
+                const uint32_t binaryHeader[ 2 ] = { (uint32_t)this->m_binarySize, 0x004e4942 };
+                stream.write( (const char*)binaryHeader, sizeof( binaryHeader ) );
+                std::ifstream binary( this->m_binaryPath, std::ios::binary );
+                stream << binary.rdbuf();
+            }
+            if( !stream ) {
+                spdlog::warn( "glb {} couldn't be written", this->m_path );
+                stream.close();
+                std::error_code error;
+                std::filesystem::remove( temporaryPath, error );
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename( temporaryPath, this->m_path, error );
+        if( error ) {
+            spdlog::warn( "glb {} couldn't be written: {}", this->m_path, error.message() );
+            std::filesystem::remove( temporaryPath, error );
+            return false;
+        }
+        spdlog::info( "glb {} written: {} entities, {} meshes, {} instances, {} materials, {} KB", this->m_path, this->m_entitiesCount,
+                      this->m_meshesCount, this->m_instancesCount, this->m_materialIndices.size(), length / 1024 );
+        return true;
+    }
+
+private:
+    // glTF constants
+    static constexpr int UNSIGNED_SHORT = 5123;
+    static constexpr int UNSIGNED_INT = 5125;
+    static constexpr int FLOAT = 5126;
+    static constexpr int ARRAY_BUFFER = 34962;
+    static constexpr int ELEMENT_ARRAY_BUFFER = 34963;
+
+    std::string m_path;
+    std::string m_binaryPath;
+    std::ofstream m_binary;
+    uint64_t m_binarySize = 0;
+    size_t m_entitiesCount = 0;
+    size_t m_instancesCount = 0;
+    // The root node is 0
+    size_t m_nodesCount = 1;
+    size_t m_meshesCount = 0;
+    size_t m_accessorsCount = 0;
+    bool m_isQuantized = false;
+    std::unordered_map<unsigned int, size_t> m_materialIndices;
+    // Mesh of every prototype, unless it has no primitives, and the geometry which decodes its positions
+    std::vector<std::pair<std::optional<size_t>, GlbGeometry>> m_prototypes;
+    std::string m_rootChildren;
+    std::string m_nodes;
+    std::string m_meshes;
+    std::string m_materials;
+    std::string m_accessors;
+    std::string m_bufferViews;
+
+    static inline void AddSeparator( std::string* json ) {
+        if( !json->empty() ) {
+            *json += ',';
+        }
+    }
+
+    inline uint64_t WriteBytes( const GlbChunk& chunk ) {
+        const auto chunkOffset = this->m_binarySize;
+        this->m_binary.write( (const char*)chunk.m_bytes.data(), (std::streamsize)chunk.m_bytes.size() );
+        this->m_binarySize += chunk.m_bytes.size();
+        return chunkOffset;
+    }
+
+    // Adds the mesh of the geometry, returns its index
+    inline size_t AddMesh( const GlbGeometry& geometry, uint64_t chunkOffset ) {
+        AddSeparator( &this->m_meshes );
+        this->m_meshes += "{\"primitives\":[";
+        for( size_t p = 0; p < geometry.m_primitives.size(); p++ ) {
+            this->m_meshes += ( p ? ",{" : "{" ) + this->AddPrimitive( geometry.m_primitives[ p ], chunkOffset ) + "}";
+        }
+        this->m_meshes += "]}";
+        return this->m_meshesCount++;
+    }
+
+    // Translation and scale of a node which decode the positions of the geometry
+    static inline std::string GetDecodingMembers( const GlbGeometry& geometry ) {
+        const auto& t = geometry.m_translation;
+        auto members = fmt::format( ",\"translation\":[{},{},{}]", t[ 0 ], t[ 1 ], t[ 2 ] );
+        if( geometry.m_isScaled ) {
+            members += fmt::format( ",\"scale\":[{},{},{}]", geometry.m_scale[ 0 ], geometry.m_scale[ 1 ], geometry.m_scale[ 2 ] );
+        }
+        return members;
+    }
+
+    // Column-major glTF matrix of the instance transformation applied after decoding the positions of the prototype
+    static inline std::string GetInstanceMatrix( const AffineTransform& transform, const GlbGeometry& prototype ) {
+        const auto& m = transform.m_data;
+        const auto& s = prototype.m_scale;
+        const auto& o = prototype.m_translation;
+        std::array<double, 16> matrix {};
+        for( int r = 0; r < 3; r++ ) {
+            for( int c = 0; c < 3; c++ ) {
+                matrix[ c * 4 + r ] = m[ r * 4 + c ] * s[ c ];
+            }
+            matrix[ 12 + r ] = m[ r * 4 ] * o[ 0 ] + m[ r * 4 + 1 ] * o[ 1 ] + m[ r * 4 + 2 ] * o[ 2 ] + m[ r * 4 + 3 ];
+        }
+        matrix[ 15 ] = 1;
+        std::string json;
+        for( const auto value: matrix ) {
+            AddSeparator( &json );
+            json += fmt::format( "{}", value );
+        }
+        return "[" + json + "]";
+    }
+
+    // Adds the accessors and buffer views of the primitive and its material if it's new, returns its JSON members.
+    // Every accessor has its own buffer view, so both have the same index.
+    inline std::string AddPrimitive( const GlbPrimitive& primitive, uint64_t chunkOffset ) {
+        this->m_isQuantized |= primitive.m_isQuantized;
+        const auto positions = this->m_accessorsCount++;
+        AddSeparator( &this->m_bufferViews );
+        this->m_bufferViews += fmt::format( "{{\"buffer\":0,\"byteOffset\":{},\"byteLength\":{},\"byteStride\":{},\"target\":{}}}",
+                                            chunkOffset + primitive.m_positionsOffset, primitive.m_indicesOffset - primitive.m_positionsOffset,
+                                            primitive.m_isQuantized ? 8 : 12, ARRAY_BUFFER );
+        AddSeparator( &this->m_accessors );
+        this->m_accessors += fmt::format( "{{\"bufferView\":{},\"componentType\":{},\"count\":{},\"type\":\"VEC3\",\"min\":[{},{},{}],\"max\":[{},{},{}]}}",
+                                          positions, primitive.m_isQuantized ? UNSIGNED_SHORT : FLOAT, primitive.m_verticesCount, primitive.m_min[ 0 ],
+                                          primitive.m_min[ 1 ], primitive.m_min[ 2 ], primitive.m_max[ 0 ], primitive.m_max[ 1 ], primitive.m_max[ 2 ] );
+
+        const auto indices = this->m_accessorsCount++;
+        AddSeparator( &this->m_bufferViews );
+        this->m_bufferViews += fmt::format( "{{\"buffer\":0,\"byteOffset\":{},\"byteLength\":{},\"target\":{}}}", chunkOffset + primitive.m_indicesOffset,
+                                            primitive.m_indicesCount * ( primitive.m_isShortIndices ? 2 : 4 ), ELEMENT_ARRAY_BUFFER );
+        AddSeparator( &this->m_accessors );
+        this->m_accessors += fmt::format( "{{\"bufferView\":{},\"componentType\":{},\"count\":{},\"type\":\"SCALAR\"}}", indices,
+                                          primitive.m_isShortIndices ? UNSIGNED_SHORT : UNSIGNED_INT, primitive.m_indicesCount );
+
+        auto [ material, isNew ] = this->m_materialIndices.try_emplace( primitive.m_color, this->m_materialIndices.size() );
+        if( isNew ) {
+            // Colors are ABGR, glTF expects linear color factors
+            auto toLinear = []( unsigned int c ) {
+                const double value = (double)( c & 0xff ) / 255.0;
+                return value <= 0.04045 ? value / 12.92 : std::pow( ( value + 0.055 ) / 1.055, 2.4 );
+            };
+            const auto color = primitive.m_color;
+            AddSeparator( &this->m_materials );
+            this->m_materials +=
+                fmt::format( "{{\"pbrMetallicRoughness\":{{\"baseColorFactor\":[{:.6f},{:.6f},{:.6f},{:.6f}],\"metallicFactor\":0,\"roughnessFactor\":1}},"
+                             "\"doubleSided\":true{}}}",
+                             toLinear( color ), toLinear( color >> 8 ), toLinear( color >> 16 ), (double)( color >> 24 ) / 255.0,
+                             ( color >> 24 ) != 255 ? ",\"alphaMode\":\"BLEND\"" : "" );
+        }
+        // No normals, viewers compute flat normals then
+        return fmt::format( "\"attributes\":{{\"POSITION\":{}}},\"indices\":{},\"material\":{}", positions, indices, material->second );
+    }
+
+    [[nodiscard]] inline std::string BuildJson() const {
+        std::string json = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"ifcplusplus example\"}";
+        if( this->m_isQuantized ) {
+            json += ",\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"]";
+        }
+        // The root node turns the Z up coordinates of IFC into the Y up coordinates of glTF, the entities follow it
+        json += ",\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"name\":\"IFC\",\"rotation\":[-0.7071067811865476,0,0,0.7071067811865476]";
+        if( this->m_entitiesCount ) {
+            json += ",\"children\":[" + this->m_rootChildren + "]},";
+            json += this->m_nodes;
+        } else {
+            json += "}";
+        }
+        json += "]";
+        const std::pair<const char*, const std::string*> arrays[] = {
+            { "meshes", &this->m_meshes }, { "materials", &this->m_materials }, { "accessors", &this->m_accessors }, { "bufferViews", &this->m_bufferViews }
+        };
+        for( const auto& [ name, values ]: arrays ) {
+            if( !values->empty() ) {
+                json += fmt::format( ",\"{}\":[", name ) + *values + "]";
+            }
+        }
+        if( this->m_binarySize ) {
+            json += fmt::format( ",\"buffers\":[{{\"byteLength\":{}}}]", this->m_binarySize );
+        }
+        return json + "}";
+    }
+};
+
+// Encodes items in chunks on up to m_threadsCount threads, finished chunks are appended in order while the
+// next ones are encoded
+template<typename TEncode, typename TAppend>
+void EncodeGlbChunks( size_t itemsCount, const GlbOptions& options, TEncode encode, TAppend append ) {
+    const auto chunkItemsCount = std::max<size_t>( options.m_chunkEntitiesCount, 1 );
+    const auto chunksCount = ( itemsCount + chunkItemsCount - 1 ) / chunkItemsCount;
+    const auto threadsCount = (size_t)std::max( options.m_threadsCount, 1 );
+
+    for( size_t firstChunk = 0; firstChunk < chunksCount; firstChunk += threadsCount ) {
+        const auto endChunk = std::min( firstChunk + threadsCount, chunksCount );
+        std::vector<GlbChunk> chunks( endChunk - firstChunk );
+        std::atomic<size_t> nextChunk = firstChunk;
+        auto worker = [ & ]() {
+            for( size_t c = nextChunk++; c < endChunk; c = nextChunk++ ) {
+                auto& chunk = chunks[ c - firstChunk ];
+                for( size_t i = c * chunkItemsCount; i < std::min( ( c + 1 ) * chunkItemsCount, itemsCount ); i++ ) {
+                    chunk.m_nodes.push_back( encode( i, &chunk.m_bytes ) );
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for( size_t t = 1; t < chunks.size(); t++ ) {
+            threads.emplace_back( worker );
+        }
+        worker();
+        for( auto& t: threads ) {
+            t.join();
+        }
+        for( const auto& c: chunks ) {
+            append( c );
+        }
+    }
+}
+
+// Writes the meshes of the entities as binary glTF, every entity becomes a node named by its GlobalId with its
+// type, name and storey as extras. Geometry shared by instances is written once and drawn by a child node of
+// every instance. Chunks of entities are encoded in parallel and written in order through a temporary file, so
+// only the JSON and the chunks in flight are held in memory. Polylines aren't exported.
+template<typename TEntity>
+bool ExportGlb( const std::vector<std::shared_ptr<TEntity>>& entities, const std::string& path, const GlbOptions& options = {} ) {
+    TRACE_SCOPE( "ExportGlb" );
+    GlbWriter writer( path );
+    const auto precision = options.m_quantizePositions ? StoragePrecision::QUANTIZED16 : StoragePrecision::FLOAT32;
+    const auto prototypes = GlbPrototypes::Collect( entities );
+    EncodeGlbChunks(
+        prototypes.m_keys.size(), options,
+        [ & ]( size_t p, std::vector<std::byte>* bytes ) { return EncodeGlbPrototype( prototypes.m_keys[ p ], precision, bytes ); },
+        [ & ]( const GlbChunk& chunk ) { writer.AppendPrototypes( chunk ); } );
+    EncodeGlbChunks(
+        entities.size(), options, [ & ]( size_t e, std::vector<std::byte>* bytes ) { return EncodeGlbNode( *entities[ e ], precision, prototypes, bytes ); },
+        [ & ]( const GlbChunk& chunk ) { writer.Append( chunk ); } );
+    return writer.Finish();
+}
+
+};
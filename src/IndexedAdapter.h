@@ -0,0 +1,231 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Adapter.h"
+
+
+namespace IfcppExample {
+
+
+// Triangle mesh with shared corners: every vertex is stored once and triangles are triples of indices into
+// m_vertices. It takes about a sixth of the memory of the same triangles as csg::Polygon.
+class IndexedMesh {
+public:
+    std::vector<csg::Vector> m_vertices;
+    std::vector<uint32_t> m_indices;
+    unsigned int m_color = 0;
+
+    // Fans the polygons into triangles, bitwise equal corners are merged
+    static inline IndexedMesh FromPolygons( const std::vector<csg::Polygon>& polygons, unsigned int color = 0 ) {
+        IndexedMesh mesh;
+        mesh.m_color = color;
+        VertexMap map;
+        for( const auto& p: polygons ) {
+            for( size_t i = 1; i + 1 < p.vertices.size(); i++ ) {
+                mesh.m_indices.push_back( mesh.AddVertex( p.vertices[ 0 ], &map ) );
+                mesh.m_indices.push_back( mesh.AddVertex( p.vertices[ i ], &map ) );
+                mesh.m_indices.push_back( mesh.AddVertex( p.vertices[ i + 1 ], &map ) );
+            }
+        }
+        return mesh;
+    }
+
+    static inline IndexedMesh FromTriangles( const std::vector<std::array<csg::Vector, 3>>& triangles, unsigned int color = 0 ) {
+        IndexedMesh mesh;
+        mesh.m_color = color;
+        mesh.m_indices.reserve( triangles.size() * 3 );
+        VertexMap map;
+        for( const auto& t: triangles ) {
+            for( const auto& v: t ) {
+                mesh.m_indices.push_back( mesh.AddVertex( v, &map ) );
+            }
+        }
+        return mesh;
+    }
+
+    // Polygon form for the CSG operations, degenerate triangles are dropped
+    [[nodiscard]] inline std::vector<csg::Polygon> ToPolygons() const {
+        std::vector<csg::Polygon> polygons;
+        polygons.reserve( this->m_indices.size() / 3 );
+        for( size_t i = 0; i + 2 < this->m_indices.size(); i += 3 ) {
+            csg::Polygon p( { this->m_vertices[ this->m_indices[ i ] ], this->m_vertices[ this->m_indices[ i + 1 ] ],
+                              this->m_vertices[ this->m_indices[ i + 2 ] ] } );
+            if( p.plane.IsValid() ) {
+                polygons.push_back( std::move( p ) );
+            }
+        }
+        return polygons;
+    }
+
+    [[nodiscard]] inline size_t GetBytes() const {
+        return this->m_vertices.capacity() * sizeof( csg::Vector ) + this->m_indices.capacity() * sizeof( uint32_t );
+    }
+
+private:
+    struct VertexHash {
+        inline size_t operator()( const csg::Vector& v ) const {
+            uint64_t bits[ 3 ];
+            std::memcpy( bits, &v.x, sizeof( double ) );
+            std::memcpy( bits + 1, &v.y, sizeof( double ) );
+            std::memcpy( bits + 2, &v.z, sizeof( double ) );
+            return ( bits[ 0 ] * 73856093 ) ^ ( bits[ 1 ] * 19349663 ) ^ ( bits[ 2 ] * 83492791 );
+        }
+    };
+    struct VertexEqual {
+        inline bool operator()( const csg::Vector& a, const csg::Vector& b ) const {
+            return a.x == b.x && a.y == b.y && a.z == b.z;
+        }
+    };
+    using VertexMap = std::unordered_map<csg::Vector, uint32_t, VertexHash, VertexEqual>;
+
+    inline uint32_t AddVertex( const csg::Vector& v, VertexMap* map ) {
+        auto [ it, isInserted ] = map->try_emplace( v, (uint32_t)this->m_vertices.size() );
+        if( isInserted ) {
+            this->m_vertices.push_back( v );
+        }
+        return it->second;
+    }
+};
+
+class IndexedEntity {
+public:
+    std::shared_ptr<IFC4X3::IfcObjectDefinition> m_ifcObject;
+    std::vector<std::shared_ptr<IndexedMesh>> m_meshes;
+    std::vector<std::shared_ptr<Polyline>> m_polylines;
+    EntityMetadata m_metadata;
+};
+
+// Adapter which keeps finished geometry as IndexedMesh. Meshes are converted to polygons only for boolean
+// operations, which are delegated to Adapter, and the results are converted back right away.
+class IndexedAdapter {
+public:
+    using TEntity = std::shared_ptr<IndexedEntity>;
+    using TTriangle = std::array<csg::Vector, 3>;
+    using TPolyline = Adapter::TPolyline;
+    using TMesh = std::shared_ptr<IndexedMesh>;
+    using TVector = csg::Vector;
+
+    inline TTriangle CreateTriangle( const std::vector<TVector>& vertices, const std::vector<int>& indices ) {
+        if( indices.size() != 3 ) {
+            // Degenerate, dropped when converted to polygons
+            return {};
+        }
+        return { vertices[ indices[ 0 ] ], vertices[ indices[ 1 ] ], vertices[ indices[ 2 ] ] };
+    }
+    inline TPolyline CreatePolyline( const std::vector<TVector>& vertices ) {
+        return this->m_adapter.CreatePolyline( vertices );
+    }
+    inline TPolyline CreatePolyline( std::vector<TVector>&& vertices ) {
+        return this->m_adapter.CreatePolyline( std::move( vertices ) );
+    }
+    inline TMesh CreateMesh( const std::vector<TTriangle>& triangles ) {
+        TRACE_GEOMETRY_STARTED();
+        return MakeShared<IndexedMesh>( IndexedMesh::FromTriangles( triangles ) );
+    }
+    inline TPolyline CreatePolyline( const TPolyline& other ) {
+        return this->m_adapter.CreatePolyline( other );
+    }
+    inline TMesh CreateMesh( const TMesh& other ) {
+        return MakeShared<IndexedMesh>( *other );
+    }
+    inline TEntity CreateEntity( const std::shared_ptr<IFC4X3::IfcObjectDefinition>& ifcObject, const std::vector<TMesh>& meshes,
+                                 const std::vector<TPolyline>& polylines ) {
+        auto entity = MakeShared<IndexedEntity>(
+            IndexedEntity { releaseIfcObjects ? nullptr : ifcObject, meshes, polylines, EntityMetadata::FromIfcObject( ifcObject ) } );
+        TRACE_ENTITY_FINISHED( entity->m_metadata.m_type );
+        return entity;
+    }
+    inline TEntity CreateEntity( const std::shared_ptr<IFC4X3::IfcObjectDefinition>& ifcObject, std::vector<TMesh>&& meshes,
+                                 std::vector<TPolyline>&& polylines ) {
+        auto entity = MakeShared<IndexedEntity>( IndexedEntity { releaseIfcObjects ? nullptr : ifcObject, std::move( meshes ), std::move( polylines ),
+                                                                 EntityMetadata::FromIfcObject( ifcObject ) } );
+        TRACE_ENTITY_FINISHED( entity->m_metadata.m_type );
+        return entity;
+    }
+
+    inline void Transform( std::vector<TMesh>* meshes, const ifcpp::Matrix<TVector>& matrix ) {
+        AffineTransform::FromMatrix( matrix ).TransformPoints( [ & ]( const auto& callback ) {
+            for( auto& m: *meshes ) {
+                for( auto& v: m->m_vertices ) {
+                    callback( v );
+                }
+            }
+        } );
+    }
+    inline void Transform( std::vector<TPolyline>* polylines, const ifcpp::Matrix<TVector>& matrix ) {
+        this->m_adapter.Transform( polylines, matrix );
+    }
+
+    inline void AddStyles( std::vector<TMesh>* meshes, const std::vector<std::shared_ptr<ifcpp::Style>>& styles ) {
+        const auto color = Adapter::GetSurfaceColor( styles );
+        if( !color ) {
+            return;
+        }
+        for( auto& m: *meshes ) {
+            if( !m->m_color ) {
+                m->m_color = color;
+            }
+        }
+    }
+    inline void AddStyles( std::vector<TPolyline>* polylines, const std::vector<std::shared_ptr<ifcpp::Style>>& styles ) {
+        this->m_adapter.AddStyles( polylines, styles );
+    }
+
+    inline std::vector<int> Triangulate( const std::vector<TVector>& loop ) {
+        return this->m_adapter.Triangulate( loop );
+    }
+    inline std::vector<int> Triangulate( const std::vector<std::vector<TVector>>& loops ) {
+        return this->m_adapter.Triangulate( loops );
+    }
+
+    inline std::vector<TMesh> ComputeUnion( const std::vector<TMesh>& operand1, const std::vector<TMesh>& operand2 ) {
+        if( operand1.empty() ) {
+            return operand2;
+        } else if( operand2.empty() ) {
+            return operand1;
+        }
+        return FromPolygonMeshes( this->m_adapter.ComputeUnion( ToPolygonMeshes( operand1 ), ToPolygonMeshes( operand2 ) ) );
+    }
+    inline std::vector<TMesh> ComputeIntersection( const std::vector<TMesh>& operand1, const std::vector<TMesh>& operand2 ) {
+        if( operand1.empty() || operand2.empty() ) {
+            return {};
+        }
+        return FromPolygonMeshes( this->m_adapter.ComputeIntersection( ToPolygonMeshes( operand1 ), ToPolygonMeshes( operand2 ) ) );
+    }
+    inline std::vector<TMesh> ComputeDifference( const std::vector<TMesh>& operand1, const std::vector<TMesh>& operand2 ) {
+        if( operand1.empty() || operand2.empty() ) {
+            return operand1;
+        }
+        return FromPolygonMeshes( this->m_adapter.ComputeDifference( ToPolygonMeshes( operand1 ), ToPolygonMeshes( operand2 ) ) );
+    }
+
+private:
+    Adapter m_adapter;
+
+    static inline std::vector<Adapter::TMesh> ToPolygonMeshes( const std::vector<TMesh>& meshes ) {
+        std::vector<Adapter::TMesh> result;
+        result.reserve( meshes.size() );
+        for( const auto& m: meshes ) {
+            result.push_back( MakeShared<Mesh>( Mesh { m->ToPolygons(), m->m_color } ) );
+        }
+        return result;
+    }
+
+    static inline std::vector<TMesh> FromPolygonMeshes( const std::vector<Adapter::TMesh>& meshes ) {
+        std::vector<TMesh> result;
+        result.reserve( meshes.size() );
+        std::vector<csg::Polygon> storage;
+        for( const auto& m: meshes ) {
+            result.push_back( MakeShared<IndexedMesh>( IndexedMesh::FromPolygons( m->GetPolygons( &storage ), m->m_color ) ) );
+        }
+        return result;
+    }
+};
+
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <spdlog/spdlog.h>
+
+
+namespace IfcppExample {
+
+
+// Contents of a JSON string literal, the value must be UTF-8
+inline std::string EscapeJson( const std::string& value ) {
+    std::string result;
+    for( const char c: value ) {
+        if( c == '"' || c == '\\' ) {
+            result += '\\';
+            result += c;
+        } else if( (unsigned char)c < 0x20 ) {
+            result += fmt::format( "\\u{:04x}", (int)c );
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace IfcppExample {
+
+
+// Read-only mapping of a whole file. The pages are read in by the OS on first access, so opening a large file
+// costs nothing until its contents are used. Empty if the file doesn't exist, is empty or can't be mapped.
+class MappedFile {
+public:
+    explicit MappedFile( const std::string& path ) {
+#ifdef _WIN32
+        this->m_file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+        if( this->m_file == INVALID_HANDLE_VALUE ) {
+            return;
+        }
+        LARGE_INTEGER size;
+        if( !GetFileSizeEx( this->m_file, &size ) || size.QuadPart == 0 ) {
+            return;
+        }
+        this->m_mapping = CreateFileMappingA( this->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+        if( !this->m_mapping ) {
+            return;
+        }
+        this->m_data = (const std::byte*)MapViewOfFile( this->m_mapping, FILE_MAP_READ, 0, 0, 0 );
+        this->m_size = this->m_data ? (size_t)size.QuadPart : 0;
+#else
+        const int file = open( path.c_str(), O_RDONLY );
+        if( file < 0 ) {
+            return;
+        }
+        struct stat status;
+        if( fstat( file, &status ) == 0 && status.st_size > 0 ) {
+            void* data = mmap( nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+            if( data != MAP_FAILED ) {
+                this->m_data = (const std::byte*)data;
+                this->m_size = (size_t)status.st_size;
+            }
+        }
+        // The mapping stays valid after the descriptor is closed
+        close( file );
+#endif
+    }
+
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator=( const MappedFile& ) = delete;
+
+    MappedFile( MappedFile&& other ) noexcept
+        : m_data( std::exchange( other.m_data, nullptr ) )
+        , m_size( std::exchange( other.m_size, 0 ) )
+#ifdef _WIN32
+        , m_file( std::exchange( other.m_file, INVALID_HANDLE_VALUE ) )
+        , m_mapping( std::exchange( other.m_mapping, nullptr ) )
+#endif
+    {
+    }
+    MappedFile& operator=( MappedFile&& other ) noexcept {
+        std::swap( this->m_data, other.m_data );
+        std::swap( this->m_size, other.m_size );
+#ifdef _WIN32
+        std::swap( this->m_file, other.m_file );
+        std::swap( this->m_mapping, other.m_mapping );
+#endif
+        return *this;
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if( this->m_data ) {
+            UnmapViewOfFile( this->m_data );
+        }
+        if( this->m_mapping ) {
+            CloseHandle( this->m_mapping );
+        }
+        if( this->m_file != INVALID_HANDLE_VALUE ) {
+            CloseHandle( this->m_file );
+        }
+#else
+        if( this->m_data ) {
+            munmap( (void*)this->m_data, this->m_size );
+        }
+#endif
+    }
+
+    // How the contents will be read. SEQUENTIAL makes the OS read further ahead on page faults and drop pages
+    // behind the reader sooner, WILL_NEED starts reading the whole file into the page cache in the background,
+    // which also serves other readers of the file.
+    enum class Access { SEQUENTIAL, WILL_NEED };
+
+    inline void Advise( Access access ) const {
+        if( !this->m_data ) {
+            return;
+        }
+#ifdef _WIN32
+        // Sequential access can only be requested when the file is opened
+#if _WIN32_WINNT >= 0x0602
+        if( access == Access::WILL_NEED ) {
+            WIN32_MEMORY_RANGE_ENTRY range { (void*)this->m_data, this->m_size };
+            PrefetchVirtualMemory( GetCurrentProcess(), 1, &range, 0 );
+        }
+#endif
+#else
+        madvise( (void*)this->m_data, this->m_size, access == Access::SEQUENTIAL ? MADV_SEQUENTIAL : MADV_WILLNEED );
+#endif
+    }
+
+    [[nodiscard]] inline bool IsOpen() const {
+        return this->m_data != nullptr;
+    }
+    // The address doesn't change when the MappedFile is moved, so views into the data stay valid
+    [[nodiscard]] inline std::span<const std::byte> GetData() const {
+        return { this->m_data, this->m_size };
+    }
+
+private:
+    const std::byte* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+};
+
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "Consolidation.h"
+#include "EntityMetadata.h"
+#include "MappedFile.h"
+#include "Polylines.h"
+#include "Trace.h"
+
+
+namespace IfcppExample {
+
+
+// Increment when the cache layout or the meaning of the cached buffers changes, older files are then rebuilt
+constexpr uint32_t MODEL_CACHE_VERSION = 1;
+
+// Metadata strings of all entities in one character buffer, the strings of entity i are
+// m_chars[ m_offsets[ i * FIELDS_COUNT + f ] .. m_offsets[ i * FIELDS_COUNT + f + 1 ] )
+class MetadataTable {
+public:
+    static constexpr int FIELDS_COUNT = 4;
+
+    std::vector<uint32_t> m_offsets = { 0 };
+    std::string m_chars;
+
+    inline void Add( const EntityMetadata& metadata ) {
+        for( const auto* s: { &metadata.m_globalId, &metadata.m_type, &metadata.m_name, &metadata.m_storey } ) {
+            this->m_chars += *s;
+            this->m_offsets.push_back( (uint32_t)this->m_chars.size() );
+        }
+    }
+};
+
+// Metadata of an entity as views into a MetadataTable or a cache file
+struct EntityMetadataView {
+    std::string_view m_globalId;
+    std::string_view m_type;
+    std::string_view m_name;
+    std::string_view m_storey;
+};
+
+// Everything SendToGpu uploads, viewed either in a ConsolidatedModel and the line strips built from the same
+// entities, or in a mapped cache file
+class GpuModel {
+public:
+    std::span<const float> m_vertices;
+    std::span<const unsigned int> m_indices;
+    std::span<const MaterialBucket> m_buckets;
+    std::span<const EntityRange> m_bucketRanges;
+    std::span<const std::array<float, 4>> m_entityBounds;
+    std::span<const Instance> m_instances;
+    std::span<const InstanceGroup> m_instanceGroups;
+    std::span<const float> m_lineVertices;
+    std::span<const unsigned int> m_lineColors;
+    std::span<const unsigned int> m_lineIndices;
+    std::span<const uint32_t> m_metadataOffsets;
+    std::span<const char> m_metadataChars;
+    int m_firstTransparentBucket = 0;
+    int m_lodLevelsCount = 1;
+    csg::Vector m_center;
+
+    static inline GpuModel FromModel( const ConsolidatedModel& model, const LineStrips& lines, const MetadataTable& metadata ) {
+        return { model.m_vertices,       model.m_indices,       model.m_buckets,     model.m_bucketRanges, model.m_entityBounds,
+                 model.m_instances,      model.m_instanceGroups, lines.m_vertices,   lines.m_colors,       lines.m_indices,
+                 metadata.m_offsets,     metadata.m_chars,      model.m_firstTransparentBucket, model.m_lodLevelsCount, model.m_center };
+    }
+
+    [[nodiscard]] inline size_t GetEntitiesCount() const {
+        return this->m_metadataOffsets.empty() ? 0 : ( this->m_metadataOffsets.size() - 1 ) / MetadataTable::FIELDS_COUNT;
+    }
+    [[nodiscard]] inline EntityMetadataView GetMetadata( size_t entity ) const {
+        std::array<std::string_view, MetadataTable::FIELDS_COUNT> fields;
+        for( int f = 0; f < MetadataTable::FIELDS_COUNT; f++ ) {
+            const auto from = this->m_metadataOffsets[ entity * MetadataTable::FIELDS_COUNT + f ];
+            const auto to = this->m_metadataOffsets[ entity * MetadataTable::FIELDS_COUNT + f + 1 ];
+            fields[ f ] = { this->m_metadataChars.data() + from, to - from };
+        }
+        return { fields[ 0 ], fields[ 1 ], fields[ 2 ], fields[ 3 ] };
+    }
+};
+
+// 64-bit hash of everything the cached geometry depends on
+class ModelCacheKey {
+public:
+    uint64_t m_hash = 0x9e3779b97f4a7c15ull;
+
+    template<typename T>
+        requires std::is_arithmetic_v<T>
+    inline ModelCacheKey& Add( T value ) {
+        if constexpr( std::is_floating_point_v<T> ) {
+            this->Mix( std::bit_cast<uint64_t>( (double)value ) );
+        } else {
+            this->Mix( (uint64_t)value );
+        }
+        return *this;
+    }
+
+    // Contents of the file, read through a mapping 8 bytes at a time in four independent lanes
+    inline ModelCacheKey& AddFile( const std::string& path ) {
+        const MappedFile file( path );
+        file.Advise( MappedFile::Access::SEQUENTIAL );
+        const auto data = file.GetData();
+        std::array<uint64_t, 4> lanes = { this->m_hash, this->m_hash + 1, this->m_hash + 2, this->m_hash + 3 };
+        size_t i = 0;
+        for( ; i + 32 <= data.size(); i += 32 ) {
+            for( int l = 0; l < 4; l++ ) {
+                uint64_t word;
+                std::memcpy( &word, data.data() + i + l * 8, 8 );
+                lanes[ l ] = std::rotl( lanes[ l ] ^ ( word * 0x87c37b91114253d5ull ), 31 ) * 0x4cf5ad432745937full;
+            }
+        }
+        for( const auto lane: lanes ) {
+            this->Mix( lane );
+        }
+        for( ; i < data.size(); i++ ) {
+            this->Mix( (uint64_t)data[ i ] );
+        }
+        this->Mix( data.size() );
+        return *this;
+    }
+
+private:
+    inline void Mix( uint64_t value ) {
+        this->m_hash ^= value + 0x9e3779b97f4a7c15ull + ( this->m_hash << 6 ) + ( this->m_hash >> 2 );
+        this->m_hash *= 0xff51afd7ed558ccdull;
+        this->m_hash ^= this->m_hash >> 33;
+    }
+};
+
+// Cache file mapped into memory, m_model points into it
+class CachedModel {
+public:
+    MappedFile m_file;
+    GpuModel m_model;
+};
+
+// Binary file with the buffers of a GpuModel, written after the model was built from the IFC file and mapped
+// on the next start instead of loading the IFC file again. The buffers are stored exactly as they are uploaded,
+// so reading them involves no parsing, the pages are read in by the OS while glBufferData copies them.
+class ModelCache {
+public:
+    ModelCache( std::string path, uint64_t key )
+        : m_path( std::move( path ) )
+        , m_key( key ) {
+    }
+
+    // Empty if there is no cache file, or it was written for other inputs or by another version
+    [[nodiscard]] inline std::optional<CachedModel> Load() const {
+        MappedFile file( this->m_path );
+        const auto data = file.GetData();
+        if( data.size() < sizeof( Header ) ) {
+            return std::nullopt;
+        }
+        Header header;
+        std::memcpy( &header, data.data(), sizeof( Header ) );
+        if( std::memcmp( header.m_magic, MAGIC, sizeof( MAGIC ) ) != 0 || header.m_version != MODEL_CACHE_VERSION || header.m_layout != GetLayout() ||
+            header.m_key != this->m_key ) {
+            spdlog::info( "geometry cache {} is outdated", this->m_path );
+            return std::nullopt;
+        }
+
+        GpuModel model;
+        bool isValid = true;
+        auto view = [ & ]<typename T>( std::span<const T>* result, Section section ) {
+            const auto& s = header.m_sections[ section ];
+            if( s.m_offset % alignof( T ) != 0 || s.m_size % sizeof( T ) != 0 || s.m_offset > data.size() || s.m_size > data.size() - s.m_offset ) {
+                isValid = false;
+                return;
+            }
+            *result = { (const T*)( data.data() + s.m_offset ), s.m_size / sizeof( T ) };
+        };
+        view( &model.m_vertices, VERTICES );
+        view( &model.m_indices, INDICES );
+        view( &model.m_buckets, BUCKETS );
+        view( &model.m_bucketRanges, BUCKET_RANGES );
+        view( &model.m_entityBounds, ENTITY_BOUNDS );
+        view( &model.m_instances, INSTANCES );
+        view( &model.m_instanceGroups, INSTANCE_GROUPS );
+        view( &model.m_lineVertices, LINE_VERTICES );
+        view( &model.m_lineColors, LINE_COLORS );
+        view( &model.m_lineIndices, LINE_INDICES );
+        view( &model.m_metadataOffsets, METADATA_OFFSETS );
+        view( &model.m_metadataChars, METADATA_CHARS );
+        if( !isValid || model.m_metadataOffsets.empty() || model.m_metadataOffsets.back() != model.m_metadataChars.size() ) {
+            spdlog::info( "geometry cache {} is damaged", this->m_path );
+            return std::nullopt;
+        }
+        model.m_firstTransparentBucket = header.m_firstTransparentBucket;
+        model.m_lodLevelsCount = header.m_lodLevelsCount;
+        model.m_center = csg::Vector( header.m_center[ 0 ], header.m_center[ 1 ], header.m_center[ 2 ] );
+        return CachedModel { std::move( file ), model };
+    }
+
+    // Writes a temporary file next to the cache and renames it, so an interrupted write never leaves a
+    // damaged cache behind
+    inline bool Save( const GpuModel& model ) const {
+        TRACE_SCOPE( "ModelCache::Save" );
+        Header header {};
+        std::memcpy( header.m_magic, MAGIC, sizeof( MAGIC ) );
+        header.m_version = MODEL_CACHE_VERSION;
+        header.m_layout = GetLayout();
+        header.m_key = this->m_key;
+        header.m_firstTransparentBucket = model.m_firstTransparentBucket;
+        header.m_lodLevelsCount = model.m_lodLevelsCount;
+        header.m_center[ 0 ] = model.m_center.x;
+        header.m_center[ 1 ] = model.m_center.y;
+        header.m_center[ 2 ] = model.m_center.z;
+
+        const auto temporaryPath = this->m_path + ".tmp";
+        {
+            std::ofstream stream( temporaryPath, std::ios::binary | std::ios::trunc );
+            uint64_t offset = sizeof( Header );
+            stream.write( (const char*)&header, sizeof( Header ) );
+            auto write = [ & ]<typename T>( std::span<const T> values, Section section ) {
+                static_assert( std::is_trivially_copyable_v<T> );
+                const char padding[ SECTION_ALIGNMENT ] = {};
+                const auto paddingSize = ( SECTION_ALIGNMENT - offset % SECTION_ALIGNMENT ) % SECTION_ALIGNMENT;
+                stream.write( padding, (std::streamsize)paddingSize );
+                offset += paddingSize;
+                header.m_sections[ section ] = { offset, values.size_bytes() };
+                stream.write( (const char*)values.data(), (std::streamsize)values.size_bytes() );
+                offset += values.size_bytes();
+            };
+            write( model.m_vertices, VERTICES );
+            write( model.m_indices, INDICES );
+            write( model.m_buckets, BUCKETS );
+            write( model.m_bucketRanges, BUCKET_RANGES );
+            write( model.m_entityBounds, ENTITY_BOUNDS );
+            write( model.m_instances, INSTANCES );
+            write( model.m_instanceGroups, INSTANCE_GROUPS );
+            write( model.m_lineVertices, LINE_VERTICES );
+            write( model.m_lineColors, LINE_COLORS );
+            write( model.m_lineIndices, LINE_INDICES );
+            write( model.m_metadataOffsets, METADATA_OFFSETS );
+            write( model.m_metadataChars, METADATA_CHARS );
+            stream.seekp( 0 );
+            stream.write( (const char*)&header, sizeof( Header ) );
+            if( !stream ) {
+                spdlog::warn( "geometry cache {} couldn't be written", this->m_path );
+                stream.close();
+                std::error_code error;
+                std::filesystem::remove( temporaryPath, error );
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename( temporaryPath, this->m_path, error );
+        if( error ) {
+            spdlog::warn( "geometry cache {} couldn't be written: {}", this->m_path, error.message() );
+            std::filesystem::remove( temporaryPath, error );
+            return false;
+        }
+        spdlog::info( "geometry cache {} written, {} KB", this->m_path, std::filesystem::file_size( this->m_path, error ) / 1024 );
+        return true;
+    }
+
+private:
+    enum Section {
+        VERTICES,
+        INDICES,
+        BUCKETS,
+        BUCKET_RANGES,
+        ENTITY_BOUNDS,
+        INSTANCES,
+        INSTANCE_GROUPS,
+        LINE_VERTICES,
+        LINE_COLORS,
+        LINE_INDICES,
+        METADATA_OFFSETS,
+        METADATA_CHARS,
+        SECTIONS_COUNT
+    };
+    struct SectionRange {
+        uint64_t m_offset;
+        uint64_t m_size;
+    };
+    struct Header {
+        char m_magic[ 8 ];
+        uint32_t m_version;
+        uint32_t m_layout;
+        uint64_t m_key;
+        int32_t m_firstTransparentBucket;
+        int32_t m_lodLevelsCount;
+        double m_center[ 3 ];
+        SectionRange m_sections[ SECTIONS_COUNT ];
+    };
+
+    static constexpr char MAGIC[ 8 ] = { 'I', 'F', 'C', 'P', 'P', 'G', 'E', 'O' };
+    static constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+    std::string m_path;
+    uint64_t m_key;
+
+    // The buffers are stored in memory layout, so a file written by a build with other struct sizes or byte
+    // order is treated as outdated
+    static inline uint32_t GetLayout() {
+        uint32_t layout = std::endian::native == std::endian::little ? 1 : 2;
+        for( const auto size: { sizeof( Header ), sizeof( MaterialBucket ), sizeof( EntityRange ), sizeof( Instance ), sizeof( InstanceGroup ),
+                                sizeof( csg::Vector ), (size_t)MAX_LOD_LEVELS } ) {
+            layout = layout * 31 + (uint32_t)size;
+        }
+        return layout;
+    }
+};
+
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+
+namespace IfcppExample {
+
+
+// Lock-free queue for many producers and a single consumer. Producers link their node in front of the list
+// with one compare-and-swap, the consumer detaches the whole list with one exchange. Nodes are never popped
+// one by one, so a node can't be freed and reused while a producer still compares against it (no ABA).
+template<typename T>
+class MpscQueue {
+public:
+    MpscQueue() = default;
+    MpscQueue( const MpscQueue& ) = delete;
+    MpscQueue& operator=( const MpscQueue& ) = delete;
+
+    ~MpscQueue() {
+        std::vector<T> discarded;
+        this->PopAll( &discarded );
+    }
+
+    inline void Push( T value ) {
+        auto* node = new Node { std::move( value ), this->m_head.load( std::memory_order_relaxed ) };
+        while( !this->m_head.compare_exchange_weak( node->m_next, node, std::memory_order_release, std::memory_order_relaxed ) ) {
+        }
+    }
+
+    // Appends everything pushed so far to result, in the order it was pushed by every single producer
+    inline void PopAll( std::vector<T>* result ) {
+        Node* node = this->m_head.exchange( nullptr, std::memory_order_acquire );
+        Node* reversed = nullptr;
+        while( node ) {
+            auto* next = node->m_next;
+            node->m_next = reversed;
+            reversed = node;
+            node = next;
+        }
+        while( reversed ) {
+            result->push_back( std::move( reversed->m_value ) );
+            delete std::exchange( reversed, reversed->m_next );
+        }
+    }
+
+    [[nodiscard]] inline bool IsEmpty() const {
+        return this->m_head.load( std::memory_order_acquire ) == nullptr;
+    }
+
+private:
+    struct Node {
+        T m_value;
+        Node* m_next;
+    };
+
+    std::atomic<Node*> m_head = nullptr;
+};
+
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "csgjs.h"
+#include "earcut.hpp"
+
+
+namespace IfcppExample {
+
+
+// 2D coordinate system in the plane of a loop, with the origin at its first vertex
+class PlaneFrame {
+public:
+    csg::Vector m_origin;
+    csg::Vector m_right;
+    csg::Vector m_up;
+
+    // Frame from the Newell normal of the loop, empty if the loop has no area
+    static inline std::optional<PlaneFrame> FromLoop( const std::vector<csg::Vector>& loop ) {
+        csg::Vector normal( 0, 0, 0 );
+        for( size_t i = 0, j = loop.size() - 1; i < loop.size(); j = i++ ) {
+            const auto& p = loop[ j ];
+            const auto& q = loop[ i ];
+            normal.x += ( p.y - q.y ) * ( p.z + q.z );
+            normal.y += ( p.z - q.z ) * ( p.x + q.x );
+            normal.z += ( p.x - q.x ) * ( p.y + q.y );
+        }
+        if( csg::LengthSquared( normal ) < 1e-24 ) {
+            return std::nullopt;
+        }
+        normal = csg::Normalized( normal );
+
+        auto right = csg::Cross( { 0.0f, 0.0f, 1.0f }, normal );
+        if( csg::LengthSquared( right ) < 1e-6 ) {
+            right = csg::Cross( normal, { 0.0f, -1.0f, 0.0f } );
+        }
+        right = csg::Normalized( right );
+        return PlaneFrame { loop[ 0 ], right, csg::Normalized( csg::Cross( normal, right ) ) };
+    }
+
+    [[nodiscard]] inline double X( const csg::Vector& p ) const {
+        return csg::Dot( this->m_right, p - this->m_origin );
+    }
+    [[nodiscard]] inline double Y( const csg::Vector& p ) const {
+        return csg::Dot( this->m_up, p - this->m_origin );
+    }
+};
+
+// Vertex of a loop as seen in a PlaneFrame, projected only when earcut reads its coordinates
+struct ProjectedVertex {
+    const csg::Vector* m_point;
+    const PlaneFrame* m_frame;
+};
+
+// View of a loop of csg::Vector which earcut takes as a ring, so the loop isn't copied into 2D points first
+class ProjectedLoop {
+public:
+    using value_type = ProjectedVertex;
+
+    const std::vector<csg::Vector>* m_points;
+    const PlaneFrame* m_frame;
+
+    [[nodiscard]] inline size_t size() const {
+        return this->m_points->size();
+    }
+    [[nodiscard]] inline bool empty() const {
+        return this->m_points->empty();
+    }
+    [[nodiscard]] inline ProjectedVertex operator[]( size_t i ) const {
+        return { &( *this->m_points )[ i ], this->m_frame };
+    }
+};
+
+};
+
+namespace mapbox::util {
+
+template<>
+struct nth<0, IfcppExample::ProjectedVertex> {
+    inline static double get( const IfcppExample::ProjectedVertex& v ) {
+        return v.m_frame->X( *v.m_point );
+    }
+};
+
+template<>
+struct nth<1, IfcppExample::ProjectedVertex> {
+    inline static double get( const IfcppExample::ProjectedVertex& v ) {
+        return v.m_frame->Y( *v.m_point );
+    }
+};
+
+};
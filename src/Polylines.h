@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "Adapter.h"
+
+
+namespace IfcppExample {
+
+
+// Polyline ends closer than this are joined, and points closer than this to the line through their neighbours
+// are dropped
+constexpr double POLYLINE_TOLERANCE = 1e-6;
+// Index which ends a line strip, enabled with glPrimitiveRestartIndex
+constexpr unsigned int PRIMITIVE_RESTART_INDEX = 0xffffffff;
+
+// Line strips of all polylines, separated by PRIMITIVE_RESTART_INDEX and drawn as GL_LINE_STRIP
+class LineStrips {
+public:
+    std::vector<float> m_vertices;
+    std::vector<unsigned int> m_colors;
+    std::vector<unsigned int> m_indices;
+};
+
+// Chains polylines of the same color which meet end to end, e.g. grid axes and MEP centerlines exported segment
+// by segment, into strips. A chain continues through a point only if exactly two polylines end there, so
+// branches and crossings start new strips. Collinear points are removed from the chains.
+class LineStripsBuilder {
+public:
+    inline void Add( const Polyline& polyline ) {
+        if( polyline.m_points.size() < 2 ) {
+            return;
+        }
+        auto [ it, isInserted ] = this->m_colorIndices.try_emplace( polyline.m_color, (int)this->m_colors.size() );
+        if( isInserted ) {
+            this->m_colors.push_back( { polyline.m_color, {}, {} } );
+        }
+        auto& color = this->m_colors[ it->second ];
+        const auto index = (uint32_t)color.m_polylines.size();
+        color.m_polylines.push_back( &polyline );
+        for( const auto& p: { polyline.m_points.front(), polyline.m_points.back() } ) {
+            color.m_ends[ ToKey( p ) ].push_back( index );
+        }
+        this->m_segmentsCount += polyline.m_points.size() - 1;
+    }
+
+    inline LineStrips Build() {
+        TRACE_SCOPE( "LineStripsBuilder::Build" );
+        LineStrips result;
+        size_t polylinesCount = 0;
+        size_t stripsCount = 0;
+        for( const auto& color: this->m_colors ) {
+            std::vector<bool> isUsed( color.m_polylines.size(), false );
+            auto emit = [ & ]( uint32_t first ) {
+                AppendStrip( Simplify( Chain( color, first, &isUsed ) ), color.m_color, &result );
+                stripsCount++;
+            };
+            // Chains start at ends which don't continue, what is left afterwards are closed loops
+            for( uint32_t i = 0; i < color.m_polylines.size(); i++ ) {
+                const auto& points = color.m_polylines[ i ]->m_points;
+                if( !isUsed[ i ] && ( color.m_ends.at( ToKey( points.front() ) ).size() != 2 || color.m_ends.at( ToKey( points.back() ) ).size() != 2 ) ) {
+                    emit( i );
+                }
+            }
+            for( uint32_t i = 0; i < color.m_polylines.size(); i++ ) {
+                if( !isUsed[ i ] ) {
+                    emit( i );
+                }
+            }
+            polylinesCount += color.m_polylines.size();
+        }
+        spdlog::info( "{} polylines ({} segments) merged into {} line strips, {} indices instead of {}", polylinesCount, this->m_segmentsCount,
+                      stripsCount, result.m_indices.size(), this->m_segmentsCount * 2 );
+        return result;
+    }
+
+private:
+    using Key = std::array<int64_t, 3>;
+    struct KeyHash {
+        inline size_t operator()( const Key& k ) const {
+            return ( (uint64_t)k[ 0 ] * 73856093 ) ^ ( (uint64_t)k[ 1 ] * 19349663 ) ^ ( (uint64_t)k[ 2 ] * 83492791 );
+        }
+    };
+    struct ColorPolylines {
+        unsigned int m_color;
+        std::vector<const Polyline*> m_polylines;
+        // Polylines ending at every point, a polyline is listed twice if both its ends are there
+        std::unordered_map<Key, std::vector<uint32_t>, KeyHash> m_ends;
+    };
+
+    std::unordered_map<unsigned int, int> m_colorIndices;
+    std::vector<ColorPolylines> m_colors;
+    size_t m_segmentsCount = 0;
+
+    static inline Key ToKey( const csg::Vector& p ) {
+        return { std::llround( p.x / POLYLINE_TOLERANCE ), std::llround( p.y / POLYLINE_TOLERANCE ), std::llround( p.z / POLYLINE_TOLERANCE ) };
+    }
+
+    // Points of the polyline first extended at both ends by the polylines it continues into
+    static inline std::vector<csg::Vector> Chain( const ColorPolylines& color, uint32_t first, std::vector<bool>* isUsed ) {
+        std::vector<csg::Vector> points = color.m_polylines[ first ]->m_points;
+        ( *isUsed )[ first ] = true;
+        // Extends the back, then the back of the reversed chain, which reverses it back at the end
+        for( int side = 0; side < 2; side++ ) {
+            while( true ) {
+                const auto key = ToKey( points.back() );
+                const auto& ends = color.m_ends.at( key );
+                if( ends.size() != 2 ) {
+                    break;
+                }
+                const auto next = ( *isUsed )[ ends[ 0 ] ] ? ends[ 1 ] : ends[ 0 ];
+                if( ( *isUsed )[ next ] ) {
+                    break;
+                }
+                ( *isUsed )[ next ] = true;
+                const auto& nextPoints = color.m_polylines[ next ]->m_points;
+                if( ToKey( nextPoints.front() ) == key ) {
+                    points.insert( points.end(), nextPoints.begin() + 1, nextPoints.end() );
+                } else {
+                    points.insert( points.end(), nextPoints.rbegin() + 1, nextPoints.rend() );
+                }
+            }
+            std::reverse( points.begin(), points.end() );
+        }
+        return points;
+    }
+
+    // Douglas-Peucker: keeps the point farthest from the segment between two kept points while it is farther away
+    // than the tolerance. A collinear run is checked once, in time linear in its length.
+    static inline std::vector<csg::Vector> Simplify( const std::vector<csg::Vector>& points ) {
+        auto getDistanceSquared = []( const csg::Vector& p, const csg::Vector& a, const csg::Vector& b ) {
+            const auto ab = b - a;
+            const auto lengthSquared = csg::LengthSquared( ab );
+            const auto t = lengthSquared > 0 ? std::clamp( csg::Dot( p - a, ab ) / lengthSquared, 0.0, 1.0 ) : 0.0;
+            return csg::LengthSquared( p - ( a + ab * t ) );
+        };
+        std::vector<bool> isKept( points.size(), false );
+        isKept.front() = true;
+        isKept.back() = true;
+        std::vector<std::pair<size_t, size_t>> ranges = { { 0, points.size() - 1 } };
+        while( !ranges.empty() ) {
+            const auto [ first, last ] = ranges.back();
+            ranges.pop_back();
+            double maxDistanceSquared = POLYLINE_TOLERANCE * POLYLINE_TOLERANCE;
+            size_t farthest = first;
+            for( size_t i = first + 1; i < last; i++ ) {
+                const auto distanceSquared = getDistanceSquared( points[ i ], points[ first ], points[ last ] );
+                if( distanceSquared > maxDistanceSquared ) {
+                    maxDistanceSquared = distanceSquared;
+                    farthest = i;
+                }
+            }
+            if( farthest != first ) {
+                isKept[ farthest ] = true;
+                ranges.push_back( { first, farthest } );
+                ranges.push_back( { farthest, last } );
+            }
+        }
+        std::vector<csg::Vector> result;
+        for( size_t i = 0; i < points.size(); i++ ) {
+            if( isKept[ i ] ) {
+                result.push_back( points[ i ] );
+            }
+        }
+        return result;
+    }
+
+    static inline void AppendStrip( const std::vector<csg::Vector>& points, unsigned int color, LineStrips* strips ) {
+        if( !strips->m_indices.empty() ) {
+            strips->m_indices.push_back( PRIMITIVE_RESTART_INDEX );
+        }
+        for( const auto& p: points ) {
+            strips->m_indices.push_back( (unsigned int)( strips->m_vertices.size() / 3 ) );
+            strips->m_vertices.push_back( (float)p.x );
+            strips->m_vertices.push_back( (float)p.y );
+            strips->m_vertices.push_back( (float)p.z );
+            strips->m_colors.push_back( color );
+        }
+    }
+};
+
+};
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <numbers>
+#include <vector>
+
+#include "Adapter.h"
+
+
+namespace IfcppExample {
+
+
+// Number of cells along each axis of the grid used to approximate booleans in preview mode
+inline int previewResolution = 24;
+
+// Adapter for the fast preview pass: unions just merge polygons (overlaps are hidden by the depth test),
+// differences and intersections are evaluated on a coarse voxel grid. Meshes which aren't touched by
+// the operation keep their exact geometry.
+class PreviewAdapter : public Adapter {
+public:
+    inline std::vector<TMesh> ComputeUnion( const std::vector<TMesh>& operand1, const std::vector<TMesh>& operand2 ) {
+        TRACE_SCOPE( "ComputeUnion" );
+        if( operand1.empty() ) {
+            return operand2;
+        } else if( operand2.empty() ) {
+            return operand1;
+        }
+
+        std::vector<unsigned int> colors;
+        std::vector<csg::Polygon> polygons;
+        for( const auto& operands: { &operand1, &operand2 } ) {
+            for( const auto& operand: *operands ) {
+                auto tagged = TagPolygons( operand, operand1[ 0 ]->m_color, &colors );
+                std::move( tagged.begin(), tagged.end(), std::back_inserter( polygons ) );
+            }
+        }
+        return SplitByColor( std::move( polygons ), colors );
+    }
+    inline std::vector<TMesh> ComputeIntersection( const std::vector<TMesh>& operand1, const std::vector<TMesh>& operand2 ) {
+        TRACE_SCOPE( "ComputeIntersection" );
+        if( operand1.empty() || operand2.empty() ) {
+            return {};
+        }
+
+        std::vector<csg::Polygon> storage, operandStorage;
+        for( auto& o1: operand1 ) {
+            const auto& polygons1 = o1->GetPolygons( &operandStorage );
+            VoxelGrid grid( polygons1 );
+            auto filled = grid.Voxelize( polygons1 );
+            std::vector<bool> mask( filled.size(), false );
+            for( const auto& o2: operand2 ) {
+                auto other = grid.Voxelize( o2->GetPolygons( &storage ) );
+                for( size_t i = 0; i < mask.size(); i++ ) {
+                    mask[ i ] = mask[ i ] || other[ i ];
+                }
+            }
+            for( size_t i = 0; i < filled.size(); i++ ) {
+                filled[ i ] = filled[ i ] && mask[ i ];
+            }
+            o1->SetPolygons( grid.CreatePolygons( filled ) );
+        }
+
+        return operand1;
+    }
+    inline std::vector<TMesh> ComputeDifference( const std::vector<TMesh>& operand1, const std::vector<TMesh>& operand2 ) {
+        TRACE_SCOPE( "ComputeDifference" );
+        if( operand1.empty() || operand2.empty() ) {
+            return operand1;
+        }
+
+        std::vector<csg::Polygon> storage, operandStorage;
+        for( auto& o1: operand1 ) {
+            const auto& polygons1 = o1->GetPolygons( &operandStorage );
+            VoxelGrid grid( polygons1 );
+            auto filled = grid.Voxelize( polygons1 );
+            bool isChanged = false;
+            for( const auto& o2: operand2 ) {
+                const auto& polygons = o2->GetPolygons( &storage );
+                if( !grid.Overlaps( polygons ) ) {
+                    continue;
+                }
+                auto other = grid.Voxelize( polygons );
+                for( size_t i = 0; i < filled.size(); i++ ) {
+                    if( filled[ i ] && other[ i ] ) {
+                        filled[ i ] = false;
+                        isChanged = true;
+                    }
+                }
+            }
+            if( isChanged ) {
+                o1->SetPolygons( grid.CreatePolygons( filled ) );
+            }
+        }
+
+        return operand1;
+    }
+
+private:
+    // Axis-aligned grid of previewResolution^3 cells spanning the bounding box of a mesh. Cells are
+    // stretched per axis, so thin walls and slabs still get several cells across their thickness.
+    class VoxelGrid {
+    public:
+        explicit VoxelGrid( const std::vector<csg::Polygon>& polygons )
+            : m_resolution( std::max( previewResolution, 1 ) ) {
+            for( const auto& p: polygons ) {
+                for( const auto& v: p.vertices ) {
+                    for( int a = 0; a < 3; a++ ) {
+                        m_min[ a ] = std::min( m_min[ a ], Get( v, a ) );
+                        m_max[ a ] = std::max( m_max[ a ], Get( v, a ) );
+                    }
+                }
+            }
+            for( int a = 0; a < 3; a++ ) {
+                m_step[ a ] = std::max( m_max[ a ] - m_min[ a ], csg::TOLERANCE ) / m_resolution;
+            }
+        }
+
+        [[nodiscard]] inline bool Overlaps( const std::vector<csg::Polygon>& polygons ) const {
+            std::array<double, 3> min, max;
+            min.fill( std::numeric_limits<double>::max() );
+            max.fill( -std::numeric_limits<double>::max() );
+            for( const auto& p: polygons ) {
+                for( const auto& v: p.vertices ) {
+                    for( int a = 0; a < 3; a++ ) {
+                        min[ a ] = std::min( min[ a ], Get( v, a ) );
+                        max[ a ] = std::max( max[ a ], Get( v, a ) );
+                    }
+                }
+            }
+            for( int a = 0; a < 3; a++ ) {
+                if( max[ a ] < this->m_min[ a ] || min[ a ] > this->m_max[ a ] ) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Marks the cells whose centers are inside the closed mesh: every column along Z collects the
+        // heights where it crosses the mesh triangles, and the cells between each pair of crossings are filled
+        [[nodiscard]] inline std::vector<bool> Voxelize( const std::vector<csg::Polygon>& polygons ) const {
+            const int n = this->m_resolution;
+            std::vector<std::vector<double>> columns( n * n );
+
+            for( const auto& p: polygons ) {
+                for( size_t k = 1; k + 1 < p.vertices.size(); k++ ) {
+                    const auto& a = p.vertices[ 0 ];
+                    const auto& b = p.vertices[ k ];
+                    const auto& c = p.vertices[ k + 1 ];
+                    const double det = ( b.x - a.x ) * ( c.y - a.y ) - ( c.x - a.x ) * ( b.y - a.y );
+                    if( std::fabs( det ) < 1e-12 ) {
+                        continue;
+                    }
+                    const auto [ i0, i1 ] = this->CellRange( std::min( { a.x, b.x, c.x } ), std::max( { a.x, b.x, c.x } ), 0 );
+                    const auto [ j0, j1 ] = this->CellRange( std::min( { a.y, b.y, c.y } ), std::max( { a.y, b.y, c.y } ), 1 );
+                    for( int j = j0; j <= j1; j++ ) {
+                        for( int i = i0; i <= i1; i++ ) {
+                            const double x = this->ColumnCenter( i, 0 );
+                            const double y = this->ColumnCenter( j, 1 );
+                            const double u = ( ( x - a.x ) * ( c.y - a.y ) - ( c.x - a.x ) * ( y - a.y ) ) / det;
+                            const double v = ( ( b.x - a.x ) * ( y - a.y ) - ( x - a.x ) * ( b.y - a.y ) ) / det;
+                            if( u < 0 || v < 0 || u + v > 1 ) {
+                                continue;
+                            }
+                            columns[ j * n + i ].push_back( a.z + u * ( b.z - a.z ) + v * ( c.z - a.z ) );
+                        }
+                    }
+                }
+            }
+
+            std::vector<bool> result( n * n * n, false );
+            for( int j = 0; j < n; j++ ) {
+                for( int i = 0; i < n; i++ ) {
+                    auto& hits = columns[ j * n + i ];
+                    std::sort( hits.begin(), hits.end() );
+                    for( size_t h = 1; h < hits.size(); h += 2 ) {
+                        const auto [ k0, k1 ] = this->CellRange( hits[ h - 1 ], hits[ h ], 2 );
+                        for( int k = k0; k <= k1; k++ ) {
+                            const double z = this->m_min[ 2 ] + ( k + 0.5 ) * this->m_step[ 2 ];
+                            if( z >= hits[ h - 1 ] && z <= hits[ h ] ) {
+                                result[ ( k * n + j ) * n + i ] = true;
+                            }
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+        // Emits the boundary between filled and empty cells, merging coplanar cell faces into rectangles
+        [[nodiscard]] inline std::vector<csg::Polygon> CreatePolygons( const std::vector<bool>& filled ) const {
+            const int n = this->m_resolution;
+            auto isFilled = [ & ]( std::array<int, 3> c ) {
+                for( int a = 0; a < 3; a++ ) {
+                    if( c[ a ] < 0 || c[ a ] >= n ) {
+                        return false;
+                    }
+                }
+                return (bool)filled[ ( c[ 2 ] * n + c[ 1 ] ) * n + c[ 0 ] ];
+            };
+
+            std::vector<csg::Polygon> result;
+            std::vector<bool> exposed( n * n );
+            for( int axis = 0; axis < 3; axis++ ) {
+                const int u = ( axis + 1 ) % 3;
+                const int v = ( axis + 2 ) % 3;
+                for( int side = -1; side <= 1; side += 2 ) {
+                    for( int w = 0; w < n; w++ ) {
+                        for( int iv = 0; iv < n; iv++ ) {
+                            for( int iu = 0; iu < n; iu++ ) {
+                                std::array<int, 3> c {};
+                                c[ axis ] = w;
+                                c[ u ] = iu;
+                                c[ v ] = iv;
+                                auto neighbour = c;
+                                neighbour[ axis ] += side;
+                                exposed[ iv * n + iu ] = isFilled( c ) && !isFilled( neighbour );
+                            }
+                        }
+                        for( int iv = 0; iv < n; iv++ ) {
+                            for( int iu = 0; iu < n; iu++ ) {
+                                if( !exposed[ iv * n + iu ] ) {
+                                    continue;
+                                }
+                                int uTo = iu + 1;
+                                while( uTo < n && exposed[ iv * n + uTo ] ) {
+                                    uTo++;
+                                }
+                                int vTo = iv + 1;
+                                while( vTo < n && std::all_of( exposed.begin() + vTo * n + iu, exposed.begin() + vTo * n + uTo, []( bool e ) { return e; } ) ) {
+                                    vTo++;
+                                }
+                                for( int jv = iv; jv < vTo; jv++ ) {
+                                    std::fill( exposed.begin() + jv * n + iu, exposed.begin() + jv * n + uTo, false );
+                                }
+                                result.push_back( this->CreateFace( axis, side, w, iu, uTo, iv, vTo ) );
+                            }
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+    private:
+        int m_resolution;
+        std::array<double, 3> m_min { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+        std::array<double, 3> m_max { -std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(), -std::numeric_limits<double>::max() };
+        std::array<double, 3> m_step {};
+
+        static inline double Get( const csg::Vector& v, int axis ) {
+            return axis == 0 ? v.x : ( axis == 1 ? v.y : v.z );
+        }
+
+        // Columns are shifted off the cell centers by an irrational fraction of the cell, so that rays don't
+        // run exactly through the shared edges of the triangles of axis-aligned faces
+        [[nodiscard]] inline double ColumnCenter( int i, int axis ) const {
+            return this->m_min[ axis ] + ( i + 0.5 + 1e-3 * std::numbers::sqrt2 ) * this->m_step[ axis ];
+        }
+
+        [[nodiscard]] inline std::pair<int, int> CellRange( double min, double max, int axis ) const {
+            const int from = (int)std::floor( ( min - this->m_min[ axis ] ) / this->m_step[ axis ] );
+            const int to = (int)std::floor( ( max - this->m_min[ axis ] ) / this->m_step[ axis ] );
+            return { std::max( from, 0 ), std::min( to, this->m_resolution - 1 ) };
+        }
+
+        [[nodiscard]] inline csg::Polygon CreateFace( int axis, int side, int w, int uFrom, int uTo, int vFrom, int vTo ) const {
+            const int u = ( axis + 1 ) % 3;
+            const int v = ( axis + 2 ) % 3;
+            auto corner = [ & ]( int cu, int cv ) {
+                std::array<double, 3> c {};
+                c[ axis ] = this->m_min[ axis ] + ( w + ( side > 0 ? 1 : 0 ) ) * this->m_step[ axis ];
+                c[ u ] = this->m_min[ u ] + cu * this->m_step[ u ];
+                c[ v ] = this->m_min[ v ] + cv * this->m_step[ v ];
+                return csg::Vector( c[ 0 ], c[ 1 ], c[ 2 ] );
+            };
+            csg::VertexList vertices = { corner( uFrom, vFrom ), corner( uTo, vFrom ), corner( uTo, vTo ), corner( uFrom, vTo ) };
+            if( side < 0 ) {
+                std::reverse( vertices.begin(), vertices.end() );
+            }
+            return csg::Polygon( std::move( vertices ) );
+        }
+    };
+};
+
+};
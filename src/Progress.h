@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <spdlog/spdlog.h>
+
+
+namespace IfcppExample {
+
+
+// Logs the progress of a model load from its own thread, at most once per interval and only when it changed.
+// The callback given to ifcpp just stores the value, so the geometry workers which report progress never wait
+// for the logger.
+class ProgressReporter {
+public:
+    explicit ProgressReporter( std::string name, std::chrono::milliseconds interval = std::chrono::milliseconds( 500 ) )
+        : m_name( std::move( name ) )
+        , m_interval( interval )
+        , m_thread( [ this ]() { this->Run(); } ) {
+    }
+    ProgressReporter( const ProgressReporter& ) = delete;
+    ProgressReporter& operator=( const ProgressReporter& ) = delete;
+
+    ~ProgressReporter() {
+        {
+            std::lock_guard lock( this->m_mutex );
+            this->m_isStopped = true;
+        }
+        this->m_stopped.notify_one();
+        this->m_thread.join();
+    }
+
+    // Valid while the reporter exists
+    [[nodiscard]] inline std::function<void( double )> GetCallback() {
+        return [ this ]( double progress ) { this->m_progress.store( progress, std::memory_order_relaxed ); };
+    }
+
+private:
+    std::string m_name;
+    std::chrono::milliseconds m_interval;
+    std::atomic<double> m_progress = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_stopped;
+    bool m_isStopped = false;
+    // Declared last, so it starts after the other members are initialized
+    std::thread m_thread;
+
+    inline void Run() {
+        double loggedProgress = 0;
+        std::unique_lock lock( this->m_mutex );
+        while( !this->m_stopped.wait_for( lock, this->m_interval, [ this ]() { return this->m_isStopped; } ) ) {
+            const double progress = this->m_progress.load( std::memory_order_relaxed );
+            if( progress != loggedProgress ) {
+                loggedProgress = progress;
+                spdlog::info( "{}: progress changed: {}", this->m_name, progress );
+            }
+        }
+    }
+};
+
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <vector>
+#include "IndexedAdapter.h"
+
+
+namespace IfcppExample {
+
+
+constexpr int MAX_LOD_LEVELS = 3;
+// Number of detail levels built for the meshes sent to the gpu, 1 disables simplification
+inline int lodLevelsCount = MAX_LOD_LEVELS;
+// Fraction of the triangles kept at each level
+constexpr double LOD_TRIANGLE_RATIOS[ MAX_LOD_LEVELS ] = { 1, 0.3, 0.08 };
+// Smaller meshes are drawn with all their triangles at every level
+constexpr size_t MIN_LOD_TRIANGLES = 32;
+
+// Quadric error metric simplification (Garland and Heckbert). Edges are collapsed in the order of the smallest
+// error, always onto one of their end vertices, so the result only references vertices of the input mesh and
+// can share its vertex buffer. Open borders are kept in place by extra quadrics of planes perpendicular to them.
+class MeshSimplifier {
+public:
+    explicit MeshSimplifier( const IndexedMesh& mesh )
+        : m_vertices( mesh.m_vertices )
+        , m_triangles( mesh.m_indices.size() / 3 )
+        , m_quadrics( mesh.m_vertices.size() )
+        , m_vertexTriangles( mesh.m_vertices.size() )
+        , m_versions( mesh.m_vertices.size(), 0 ) {
+        for( size_t t = 0; t < this->m_triangles.size(); t++ ) {
+            auto& triangle = this->m_triangles[ t ];
+            triangle = { mesh.m_indices[ t * 3 ], mesh.m_indices[ t * 3 + 1 ], mesh.m_indices[ t * 3 + 2 ] };
+            if( triangle[ 0 ] == triangle[ 1 ] || triangle[ 1 ] == triangle[ 2 ] || triangle[ 0 ] == triangle[ 2 ] ) {
+                this->m_isRemoved.push_back( true );
+                continue;
+            }
+            this->m_isRemoved.push_back( false );
+            this->m_trianglesCount++;
+            const auto& a = this->m_vertices[ triangle[ 0 ] ];
+            const auto normal = csg::Cross( this->m_vertices[ triangle[ 1 ] ] - a, this->m_vertices[ triangle[ 2 ] ] - a );
+            const auto length = csg::Length( normal );
+            if( length > 0 ) {
+                const auto n = normal / length;
+                const auto quadric = PlaneQuadric( n, -csg::Dot( n, a ), length / 2 );
+                for( const auto v: triangle ) {
+                    Add( &this->m_quadrics[ v ], quadric );
+                }
+            }
+            for( const auto v: triangle ) {
+                this->m_vertexTriangles[ v ].push_back( (uint32_t)t );
+            }
+        }
+        this->AddBorderQuadrics();
+        for( uint32_t v = 0; v < this->m_vertices.size(); v++ ) {
+            this->PushEdges( v, v );
+        }
+    }
+
+    [[nodiscard]] inline size_t GetTrianglesCount() const {
+        return this->m_trianglesCount;
+    }
+
+    // Collapses edges until at most targetTrianglesCount triangles are left or no edge can be collapsed,
+    // returns the remaining triangles as indices into the vertices of the input mesh. Calls with decreasing
+    // targets continue from the previous result, so coarser levels are built on top of finer ones.
+    [[nodiscard]] inline std::vector<uint32_t> Simplify( size_t targetTrianglesCount ) {
+        while( this->m_trianglesCount > targetTrianglesCount && !this->m_heap.empty() ) {
+            const auto edge = this->m_heap.top();
+            this->m_heap.pop();
+            if( this->m_versions[ edge.m_from ] != edge.m_fromVersion || this->m_versions[ edge.m_to ] != edge.m_toVersion ) {
+                continue;
+            }
+            this->Collapse( edge.m_from, edge.m_to );
+        }
+
+        std::vector<uint32_t> result;
+        result.reserve( this->m_trianglesCount * 3 );
+        for( size_t t = 0; t < this->m_triangles.size(); t++ ) {
+            if( !this->m_isRemoved[ t ] ) {
+                result.insert( result.end(), this->m_triangles[ t ].begin(), this->m_triangles[ t ].end() );
+            }
+        }
+        return result;
+    }
+
+private:
+    // Symmetric 4x4 matrix, upper triangle stored row by row
+    using Quadric = std::array<double, 10>;
+
+    struct Edge {
+        double m_cost;
+        uint32_t m_from;
+        uint32_t m_to;
+        uint32_t m_fromVersion;
+        uint32_t m_toVersion;
+
+        inline bool operator<( const Edge& other ) const {
+            // Smallest cost on the top of the heap
+            return this->m_cost > other.m_cost;
+        }
+    };
+
+    static constexpr double BORDER_WEIGHT = 100;
+    // Collapses which turn a triangle by more than ~80 degrees are rejected
+    static constexpr double MIN_NORMAL_COS = 0.2;
+    static constexpr uint32_t REMOVED = 0xffffffff;
+
+    std::vector<csg::Vector> m_vertices;
+    std::vector<std::array<uint32_t, 3>> m_triangles;
+    std::vector<bool> m_isRemoved;
+    size_t m_trianglesCount = 0;
+    std::vector<Quadric> m_quadrics;
+    std::vector<std::vector<uint32_t>> m_vertexTriangles;
+    // Incremented whenever a vertex changes, heap entries with old versions are skipped
+    std::vector<uint32_t> m_versions;
+    std::priority_queue<Edge> m_heap;
+
+    static inline Quadric PlaneQuadric( const csg::Vector& n, double d, double weight ) {
+        return { weight * n.x * n.x, weight * n.x * n.y, weight * n.x * n.z, weight * n.x * d, weight * n.y * n.y,
+                 weight * n.y * n.z, weight * n.y * d,   weight * n.z * n.z, weight * n.z * d,   weight * d * d };
+    }
+
+    static inline void Add( Quadric* q, const Quadric& other ) {
+        for( int i = 0; i < 10; i++ ) {
+            ( *q )[ i ] += other[ i ];
+        }
+    }
+
+    static inline double Error( const Quadric& q, const csg::Vector& v ) {
+        return q[ 0 ] * v.x * v.x + 2 * q[ 1 ] * v.x * v.y + 2 * q[ 2 ] * v.x * v.z + 2 * q[ 3 ] * v.x + q[ 4 ] * v.y * v.y + 2 * q[ 5 ] * v.y * v.z +
+            2 * q[ 6 ] * v.y + q[ 7 ] * v.z * v.z + 2 * q[ 8 ] * v.z + q[ 9 ];
+    }
+
+    inline void AddBorderQuadrics() {
+        // An edge is on the border if it belongs to a single triangle, i.e. the opposite edge is missing
+        std::vector<std::pair<uint64_t, uint32_t>> edges;
+        for( size_t t = 0; t < this->m_triangles.size(); t++ ) {
+            if( this->m_isRemoved[ t ] ) {
+                continue;
+            }
+            const auto& triangle = this->m_triangles[ t ];
+            for( int i = 0; i < 3; i++ ) {
+                const uint64_t a = triangle[ i ], b = triangle[ ( i + 1 ) % 3 ];
+                edges.push_back( { std::min( a, b ) << 32 | std::max( a, b ), (uint32_t)t } );
+            }
+        }
+        std::sort( edges.begin(), edges.end() );
+        for( size_t i = 0; i < edges.size(); i++ ) {
+            const bool isShared = ( i > 0 && edges[ i - 1 ].first == edges[ i ].first ) || ( i + 1 < edges.size() && edges[ i + 1 ].first == edges[ i ].first );
+            if( isShared ) {
+                continue;
+            }
+            const auto a = (uint32_t)( edges[ i ].first >> 32 );
+            const auto b = (uint32_t)( edges[ i ].first & 0xffffffff );
+            const auto& triangle = this->m_triangles[ edges[ i ].second ];
+            const auto& p = this->m_vertices[ triangle[ 0 ] ];
+            const auto faceNormal = csg::Cross( this->m_vertices[ triangle[ 1 ] ] - p, this->m_vertices[ triangle[ 2 ] ] - p );
+            const auto edge = this->m_vertices[ b ] - this->m_vertices[ a ];
+            const auto normal = csg::Cross( edge, faceNormal );
+            const auto length = csg::Length( normal );
+            if( length <= 0 ) {
+                continue;
+            }
+            const auto n = normal / length;
+            const auto quadric = PlaneQuadric( n, -csg::Dot( n, this->m_vertices[ a ] ), BORDER_WEIGHT * csg::LengthSquared( edge ) );
+            Add( &this->m_quadrics[ a ], quadric );
+            Add( &this->m_quadrics[ b ], quadric );
+        }
+    }
+
+    // Pushes the edges of v to neighbours above minNeighbour, which lets the initial pass push every edge once
+    inline void PushEdges( uint32_t v, uint32_t minNeighbour = 0 ) {
+        for( const auto t: this->m_vertexTriangles[ v ] ) {
+            if( this->m_isRemoved[ t ] ) {
+                continue;
+            }
+            for( const auto w: this->m_triangles[ t ] ) {
+                if( w == v || w < minNeighbour ) {
+                    continue;
+                }
+                // Both directions are pushed, moving v onto w and w onto v. After a collapse onto v all edges
+                // towards v are stale, so they have to be pushed again for the neighbours to collapse onto v.
+                auto q = this->m_quadrics[ v ];
+                Add( &q, this->m_quadrics[ w ] );
+                this->m_heap.push( { Error( q, this->m_vertices[ w ] ), v, w, this->m_versions[ v ], this->m_versions[ w ] } );
+                this->m_heap.push( { Error( q, this->m_vertices[ v ] ), w, v, this->m_versions[ w ], this->m_versions[ v ] } );
+            }
+        }
+    }
+
+    // Moves vertex from onto vertex to, unless that flips or degenerates one of the remaining triangles
+    inline void Collapse( uint32_t from, uint32_t to ) {
+        const auto& target = this->m_vertices[ to ];
+        for( const auto t: this->m_vertexTriangles[ from ] ) {
+            const auto& triangle = this->m_triangles[ t ];
+            if( this->m_isRemoved[ t ] || std::find( triangle.begin(), triangle.end(), to ) != triangle.end() ) {
+                continue;
+            }
+            std::array<csg::Vector, 3> moved;
+            for( int i = 0; i < 3; i++ ) {
+                moved[ i ] = triangle[ i ] == from ? target : this->m_vertices[ triangle[ i ] ];
+            }
+            const auto& a = this->m_vertices[ triangle[ 0 ] ];
+            const auto before = csg::Cross( this->m_vertices[ triangle[ 1 ] ] - a, this->m_vertices[ triangle[ 2 ] ] - a );
+            const auto after = csg::Cross( moved[ 1 ] - moved[ 0 ], moved[ 2 ] - moved[ 0 ] );
+            const auto lengths = csg::Length( before ) * csg::Length( after );
+            if( lengths <= 0 || csg::Dot( before, after ) < MIN_NORMAL_COS * lengths ) {
+                return;
+            }
+        }
+
+        for( const auto t: this->m_vertexTriangles[ from ] ) {
+            if( this->m_isRemoved[ t ] ) {
+                continue;
+            }
+            auto& triangle = this->m_triangles[ t ];
+            if( std::find( triangle.begin(), triangle.end(), to ) != triangle.end() ) {
+                this->m_isRemoved[ t ] = true;
+                this->m_trianglesCount--;
+                continue;
+            }
+            std::replace( triangle.begin(), triangle.end(), from, to );
+            this->m_vertexTriangles[ to ].push_back( t );
+        }
+        this->m_vertexTriangles[ from ].clear();
+        Add( &this->m_quadrics[ to ], this->m_quadrics[ from ] );
+        this->m_versions[ from ] = REMOVED;
+        this->m_versions[ to ]++;
+        std::erase_if( this->m_vertexTriangles[ to ], [ & ]( uint32_t t ) { return this->m_isRemoved[ t ]; } );
+        this->PushEdges( to );
+    }
+};
+
+};
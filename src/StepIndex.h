@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+namespace IfcppExample {
+
+
+// Entity instance of the DATA section of a STEP file, e.g. #12=IFCWALL(...); Offsets are in bytes from the
+// start of the file, the type is empty for complex instances like #12=(IFCA() IFCB());
+struct StepInstance {
+    uint64_t m_id;
+    uint64_t m_offset;
+    uint32_t m_length;
+    uint16_t m_typeOffset;
+    uint16_t m_typeLength;
+
+    [[nodiscard]] inline std::string_view GetType( std::string_view file ) const {
+        return file.substr( this->m_offset + this->m_typeOffset, this->m_typeLength );
+    }
+};
+
+// Splits the DATA section of a STEP physical file (ISO 10303-21) into entity instances without parsing their
+// arguments. The section is cut into chunks at instance starts, which are tokenized in parallel.
+class StepIndex {
+public:
+    std::vector<StepInstance> m_instances;
+
+    static inline StepIndex Build( std::span<const std::byte> file, int threadsCount ) {
+        const std::string_view text( (const char*)file.data(), file.size() );
+        const auto [ begin, end ] = FindDataSection( text );
+
+        // More chunks than threads, so a chunk of large instances doesn't hold up the others
+        const size_t chunksCount = std::max<size_t>( std::min<size_t>( (size_t)threadsCount * 4, ( end - begin ) / MIN_CHUNK_SIZE ), 1 );
+        std::vector<size_t> bounds = { begin };
+        for( size_t c = 1; c < chunksCount; c++ ) {
+            bounds.push_back( std::max( FindInstanceStart( text, begin + ( end - begin ) * c / chunksCount, end ), bounds.back() ) );
+        }
+        bounds.push_back( end );
+
+        std::vector<std::vector<StepInstance>> chunks( chunksCount );
+        std::atomic<size_t> nextChunk = 0;
+        auto worker = [ & ]() {
+            for( size_t c = nextChunk++; c < chunksCount; c = nextChunk++ ) {
+                Tokenize( text, bounds[ c ], bounds[ c + 1 ], &chunks[ c ] );
+            }
+        };
+        std::vector<std::thread> threads;
+        for( int t = 1; t < std::min( threadsCount, (int)chunksCount ); t++ ) {
+            threads.emplace_back( worker );
+        }
+        worker();
+        for( auto& t: threads ) {
+            t.join();
+        }
+
+        StepIndex index;
+        size_t instancesCount = 0;
+        for( const auto& c: chunks ) {
+            instancesCount += c.size();
+        }
+        index.m_instances.reserve( instancesCount );
+        for( const auto& c: chunks ) {
+            index.m_instances.insert( index.m_instances.end(), c.begin(), c.end() );
+        }
+        return index;
+    }
+
+private:
+    static constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    // From the statement after DATA; up to the last ENDSEC; of the file. Statements between several DATA
+    // sections don't start with # and are skipped by Tokenize.
+    static inline std::pair<size_t, size_t> FindDataSection( std::string_view text ) {
+        size_t position = 0;
+        while( position < text.size() ) {
+            const auto statementEnd = FindStatementEnd( text, position, text.size() );
+            auto statement = text.substr( position, statementEnd - position );
+            statement.remove_prefix( std::min( statement.find_first_not_of( " \t\r\n" ), statement.size() ) );
+            position = std::min( statementEnd + 1, text.size() );
+            if( statement.starts_with( "DATA" ) && ( statement.size() == 4 || statement[ 4 ] == '(' || std::isspace( (unsigned char)statement[ 4 ] ) ) ) {
+                const auto endSection = text.rfind( "ENDSEC" );
+                return { position, endSection == std::string_view::npos || endSection < position ? text.size() : endSection };
+            }
+        }
+        return { text.size(), text.size() };
+    }
+
+    // Position of the ; ending the statement which starts at position, skipping strings and comments
+    static inline size_t FindStatementEnd( std::string_view text, size_t position, size_t end ) {
+        while( position < end ) {
+            const char c = text[ position ];
+            if( c == ';' ) {
+                return position;
+            } else if( c == '\'' ) {
+                // Quotes inside strings are doubled
+                position++;
+                while( position < end ) {
+                    if( text[ position ] == '\'' ) {
+                        if( position + 1 < end && text[ position + 1 ] == '\'' ) {
+                            position += 2;
+                            continue;
+                        }
+                        break;
+                    }
+                    position++;
+                }
+                position++;
+            } else if( c == '/' && position + 1 < end && text[ position + 1 ] == '*' ) {
+                const auto commentEnd = text.find( "*/", position + 2 );
+                position = commentEnd == std::string_view::npos ? end : commentEnd + 2;
+            } else {
+                position++;
+            }
+        }
+        return end;
+    }
+
+    // First line at or after position which starts with #<digits>= right after the ; of the previous statement.
+    // Exporters write every instance on its own line, so this is the start of an instance unless a string
+    // contains such a line break.
+    static inline size_t FindInstanceStart( std::string_view text, size_t position, size_t end ) {
+        while( ( position = text.find( "\n#", position ) ) < end ) {
+            position++;
+            size_t previous = position - 1;
+            while( previous > 0 && std::isspace( (unsigned char)text[ previous ] ) ) {
+                previous--;
+            }
+            size_t digitsEnd = position + 1;
+            while( digitsEnd < end && std::isdigit( (unsigned char)text[ digitsEnd ] ) ) {
+                digitsEnd++;
+            }
+            while( digitsEnd < end && text[ digitsEnd ] == ' ' ) {
+                digitsEnd++;
+            }
+            if( text[ previous ] == ';' && digitsEnd > position + 1 && digitsEnd < end && text[ digitsEnd ] == '=' ) {
+                return position;
+            }
+        }
+        return end;
+    }
+
+    static inline void Tokenize( std::string_view text, size_t begin, size_t end, std::vector<StepInstance>* result ) {
+        auto skipSpace = [ & ]( size_t position ) {
+            while( position < end && std::isspace( (unsigned char)text[ position ] ) ) {
+                position++;
+            }
+            return position;
+        };
+        size_t position = begin;
+        while( ( position = skipSpace( position ) ) < end ) {
+            if( text.compare( position, 2, "/*" ) == 0 ) {
+                const auto commentEnd = text.find( "*/", position + 2 );
+                position = commentEnd == std::string_view::npos ? end : commentEnd + 2;
+                continue;
+            }
+            const auto statementStart = position;
+            const auto statementEnd = FindStatementEnd( text, position, end );
+            position = statementEnd + 1;
+            if( text[ statementStart ] != '#' ) {
+                continue;
+            }
+
+            StepInstance instance { 0, statementStart, (uint32_t)( std::min( statementEnd + 1, end ) - statementStart ), 0, 0 };
+            size_t p = statementStart + 1;
+            while( p < statementEnd && std::isdigit( (unsigned char)text[ p ] ) ) {
+                instance.m_id = instance.m_id * 10 + (uint64_t)( text[ p++ ] - '0' );
+            }
+            p = skipSpace( p );
+            if( p >= statementEnd || text[ p ] != '=' ) {
+                continue;
+            }
+            p = skipSpace( p + 1 );
+            auto typeEnd = p;
+            while( typeEnd < statementEnd && ( std::isalnum( (unsigned char)text[ typeEnd ] ) || text[ typeEnd ] == '_' ) ) {
+                typeEnd++;
+            }
+            if( p - statementStart <= UINT16_MAX && typeEnd - p <= UINT16_MAX ) {
+                instance.m_typeOffset = (uint16_t)( p - statementStart );
+                instance.m_typeLength = (uint16_t)( typeEnd - p );
+            }
+            result->push_back( instance );
+        }
+    }
+};
+
+};
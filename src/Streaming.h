@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "Adapter.h"
+#include "MpscQueue.h"
+
+
+namespace IfcppExample {
+
+
+// Triangles of a finished entity, copied out on the worker thread so that nothing done to the entity later
+// (e.g. deduplication) races with the upload. Vertices are in world coordinates, indices start at 0.
+class StreamedEntity {
+public:
+    std::vector<float> m_vertices;
+    std::vector<unsigned int> m_colors;
+    std::vector<unsigned int> m_indices;
+    std::array<float, 3> m_min;
+    std::array<float, 3> m_max;
+    // Walls, slabs, columns etc. give the outline of the building and are uploaded before everything else
+    bool m_isStructural = false;
+
+    explicit StreamedEntity( const EntityMetadata& metadata )
+        : m_isStructural( IsStructural( metadata.m_type ) ) {
+        this->m_min.fill( std::numeric_limits<float>::max() );
+        this->m_max.fill( std::numeric_limits<float>::lowest() );
+    }
+
+    // Fans the polygons of the mesh into triangles, meshes without material are skipped
+    inline void AddMesh( const Mesh& mesh, std::vector<csg::Polygon>* storage ) {
+        if( mesh.m_color == 0 ) {
+            return;
+        }
+        for( const auto& p: mesh.GetPolygons( storage ) ) {
+            const auto first = (unsigned int)( this->m_vertices.size() / 3 );
+            for( const auto& v: p.vertices ) {
+                const std::array<float, 3> position = { (float)v.x, (float)v.y, (float)v.z };
+                for( int i = 0; i < 3; i++ ) {
+                    this->m_vertices.push_back( position[ i ] );
+                    this->m_min[ i ] = std::min( this->m_min[ i ], position[ i ] );
+                    this->m_max[ i ] = std::max( this->m_max[ i ], position[ i ] );
+                }
+                this->m_colors.push_back( mesh.m_color );
+            }
+            for( unsigned int i = 1; i + 1 < p.vertices.size(); i++ ) {
+                this->m_indices.insert( this->m_indices.end(), { first, first + i, first + i + 1 } );
+            }
+        }
+    }
+
+    [[nodiscard]] inline bool IsEmpty() const {
+        return this->m_indices.empty();
+    }
+
+    [[nodiscard]] inline float GetSize() const {
+        const float dx = this->m_max[ 0 ] - this->m_min[ 0 ];
+        const float dy = this->m_max[ 1 ] - this->m_min[ 1 ];
+        const float dz = this->m_max[ 2 ] - this->m_min[ 2 ];
+        return std::sqrt( dx * dx + dy * dy + dz * dz );
+    }
+
+    // Order of the upload: structural elements first, larger ones before smaller ones
+    [[nodiscard]] inline bool IsUploadedBefore( const StreamedEntity& other ) const {
+        if( this->m_isStructural != other.m_isStructural ) {
+            return this->m_isStructural;
+        }
+        return this->GetSize() > other.GetSize();
+    }
+
+    [[nodiscard]] inline size_t GetBytes() const {
+        return ( this->m_vertices.size() + this->m_colors.size() + this->m_indices.size() ) * 4;
+    }
+
+private:
+    static inline bool IsStructural( std::string_view type ) {
+        static constexpr std::string_view structuralTypes[] = { "IfcWall",    "IfcWallStandardCase", "IfcSlab", "IfcRoof", "IfcColumn", "IfcBeam",
+                                                                "IfcFooting", "IfcPile",             "IfcStair", "IfcRamp", "IfcCurtainWall" };
+        return std::find( std::begin( structuralTypes ), std::end( structuralTypes ), type ) != std::end( structuralTypes );
+    }
+};
+
+// Entities finished by the StreamingAdapter, drained by the render loop
+inline MpscQueue<StreamedEntity> streamedEntities;
+
+// Adapter which additionally hands every finished entity to the render loop through streamedEntities, so the
+// model appears while the rest of it is still being processed
+class StreamingAdapter : public Adapter {
+public:
+    inline TEntity CreateEntity( const std::shared_ptr<IFC4X3::IfcObjectDefinition>& ifcObject, const std::vector<TMesh>& meshes,
+                                 const std::vector<TPolyline>& polylines ) {
+        return Stream( Adapter::CreateEntity( ifcObject, meshes, polylines ) );
+    }
+    inline TEntity CreateEntity( const std::shared_ptr<IFC4X3::IfcObjectDefinition>& ifcObject, std::vector<TMesh>&& meshes,
+                                 std::vector<TPolyline>&& polylines ) {
+        return Stream( Adapter::CreateEntity( ifcObject, std::move( meshes ), std::move( polylines ) ) );
+    }
+
+private:
+    static inline TEntity Stream( TEntity entity ) {
+        StreamedEntity streamed( entity->m_metadata );
+        std::vector<csg::Polygon> storage;
+        for( const auto& m: entity->m_meshes ) {
+            streamed.AddMesh( *m, &storage );
+        }
+        if( !streamed.IsEmpty() ) {
+            streamedEntities.Push( std::move( streamed ) );
+        }
+        return entity;
+    }
+};
+
+};
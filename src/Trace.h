@@ -0,0 +1,200 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+
+// Spans are recorded only when built with IFCPP_EXAMPLE_TRACE (cmake -DIFCPP_EXAMPLE_TRACE=ON) and enabled with
+// --trace FILE. Otherwise the macros expand to nothing and their arguments aren't evaluated.
+#ifdef IFCPP_EXAMPLE_TRACE
+#define TRACE_CONCAT_IMPL( a, b ) a##b
+#define TRACE_CONCAT( a, b ) TRACE_CONCAT_IMPL( a, b )
+// Records the rest of the enclosing scope as a span, name must be a string literal
+#define TRACE_SCOPE( name ) const ::IfcppExample::TraceScope TRACE_CONCAT( traceScope, __LINE__ )( name )
+// Marks that the calling thread works on the geometry of an entity
+#define TRACE_GEOMETRY_STARTED() ::IfcppExample::Tracer::Get().OnGeometryStarted()
+// Ends the span of the entity the calling thread worked on, type is copied into the span
+#define TRACE_ENTITY_FINISHED( type ) ::IfcppExample::Tracer::Get().OnEntityFinished( type )
+#else
+#define TRACE_SCOPE( name ) ( (void)0 )
+#define TRACE_GEOMETRY_STARTED() ( (void)0 )
+#define TRACE_ENTITY_FINISHED( type ) ( (void)0 )
+#endif
+
+
+namespace IfcppExample {
+
+
+// Collects spans in per-thread buffers, so recording takes no lock, and writes them in the Chrome trace event
+// format, which chrome://tracing and ui.perfetto.dev open
+class Tracer {
+public:
+    static inline Tracer& Get() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    inline void Enable() {
+        this->m_isEnabled.store( true, std::memory_order_relaxed );
+    }
+    [[nodiscard]] inline bool IsEnabled() const {
+        return this->m_isEnabled.load( std::memory_order_relaxed );
+    }
+
+    // Nanoseconds since the tracer was created
+    [[nodiscard]] inline uint64_t Now() const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - this->m_startTime ).count();
+    }
+
+    inline void Record( const char* name, uint64_t start, uint64_t end, std::string detail = {} ) {
+        this->GetThreadBuffer().m_spans.push_back( { name, start, end, std::move( detail ) } );
+    }
+
+    // ifcpp doesn't report when it starts on an entity, so an entity span starts at the first traced adapter call
+    // after the previous entity of the same thread. The first such call of a load ends its parse span.
+    inline void OnGeometryStarted() {
+        if( !this->IsEnabled() ) {
+            return;
+        }
+        auto& buffer = this->GetThreadBuffer();
+        if( buffer.m_entityStart == 0 ) {
+            buffer.m_entityStart = this->Now();
+            uint64_t expected = 0;
+            this->m_firstGeometryTime.compare_exchange_strong( expected, buffer.m_entityStart, std::memory_order_relaxed );
+        }
+    }
+    inline void OnEntityFinished( const std::string& type ) {
+        if( !this->IsEnabled() ) {
+            return;
+        }
+        auto& buffer = this->GetThreadBuffer();
+        const auto now = this->Now();
+        buffer.m_spans.push_back( { "entity", buffer.m_entityStart ? buffer.m_entityStart : now, now, type } );
+        buffer.m_entityStart = 0;
+    }
+
+    // Called around ifcpp::LoadModel, records the time until the first geometry call as parsing. With several
+    // models loaded at once the parse spans are only approximate.
+    inline uint64_t BeginLoad() {
+        this->m_firstGeometryTime.store( 0, std::memory_order_relaxed );
+        return this->Now();
+    }
+    inline void EndLoad( uint64_t start ) {
+        if( !this->IsEnabled() ) {
+            return;
+        }
+        const auto now = this->Now();
+        const auto firstGeometryTime = this->m_firstGeometryTime.load( std::memory_order_relaxed );
+        this->Record( "parse", start, firstGeometryTime > start ? firstGeometryTime : now );
+        this->Record( "LoadModel", start, now );
+    }
+
+    // Must be called when no traced work is running
+    inline bool WriteChromeTrace( const std::string& path ) const {
+        std::ofstream stream( path );
+        if( !stream ) {
+            spdlog::warn( "trace: can't write {}", path );
+            return false;
+        }
+        std::lock_guard lock( this->m_mutex );
+        size_t spansCount = 0;
+        stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool isFirst = true;
+        for( size_t t = 0; t < this->m_buffers.size(); t++ ) {
+            stream << ( isFirst ? "" : ",\n" )
+                   << fmt::format( "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"thread {}\"}}}}", t, t );
+            isFirst = false;
+            for( const auto& s: this->m_buffers[ t ]->m_spans ) {
+                stream << fmt::format( ",\n{{\"name\":\"{}\",\"cat\":\"ifcpp\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}", s.m_name, t,
+                                       (double)s.m_start / 1000.0, (double)( s.m_end - s.m_start ) / 1000.0 );
+                if( !s.m_detail.empty() ) {
+                    stream << ",\"args\":{\"type\":\"" << s.m_detail << "\"}";
+                }
+                stream << "}";
+            }
+            spansCount += this->m_buffers[ t ]->m_spans.size();
+        }
+        stream << "\n]}\n";
+        spdlog::info( "trace: {} spans of {} threads written to {}", spansCount, this->m_buffers.size(), path );
+        return (bool)stream;
+    }
+
+private:
+    struct Span {
+        const char* m_name;
+        uint64_t m_start;
+        uint64_t m_end;
+        // Entity type for entity spans, IFC class names need no escaping
+        std::string m_detail;
+    };
+    struct ThreadBuffer {
+        std::vector<Span> m_spans;
+        uint64_t m_entityStart = 0;
+    };
+
+    const std::chrono::steady_clock::time_point m_startTime = std::chrono::steady_clock::now();
+    std::atomic<bool> m_isEnabled = false;
+    std::atomic<uint64_t> m_firstGeometryTime = 0;
+    mutable std::mutex m_mutex;
+    // Owned here rather than by the threads, so the spans of finished workers are still written
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+
+    inline ThreadBuffer& GetThreadBuffer() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if( !buffer ) {
+            std::lock_guard lock( this->m_mutex );
+            buffer = this->m_buffers.emplace_back( std::make_unique<ThreadBuffer>() ).get();
+        }
+        return *buffer;
+    }
+};
+
+class TraceScope {
+public:
+    explicit TraceScope( const char* name )
+        : m_name( Tracer::Get().IsEnabled() ? name : nullptr )
+        , m_start( m_name ? Tracer::Get().Now() : 0 ) {
+    }
+    TraceScope( const TraceScope& ) = delete;
+    TraceScope& operator=( const TraceScope& ) = delete;
+    ~TraceScope() {
+        if( this->m_name ) {
+            Tracer::Get().Record( this->m_name, this->m_start, Tracer::Get().Now() );
+        }
+    }
+
+private:
+    const char* m_name;
+    uint64_t m_start;
+};
+
+// Enables the tracer for the lifetime of the session and writes the trace file at its end
+class TraceSession {
+public:
+    explicit TraceSession( std::string path )
+        : m_path( std::move( path ) ) {
+#ifdef IFCPP_EXAMPLE_TRACE
+        Tracer::Get().Enable();
+#else
+        spdlog::warn( "trace: built without IFCPP_EXAMPLE_TRACE, {} will contain no spans", this->m_path );
+#endif
+    }
+    TraceSession( const TraceSession& ) = delete;
+    TraceSession& operator=( const TraceSession& ) = delete;
+    ~TraceSession() {
+        Tracer::Get().WriteChromeTrace( this->m_path );
+    }
+
+private:
+    std::string m_path;
+};
+
+};
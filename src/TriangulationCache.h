@@ -0,0 +1,165 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "earcut.hpp"
+
+
+namespace IfcppExample {
+
+
+// Earcut results of recently triangulated loops. Profiles like beam sections, window frames or pipe rings
+// repeat all over a model in different placements, so loops are looked up by their shape in the plane only.
+// The cache is split into shards with their own lock and LRU list, each limited to MAX_SHARD_BYTES.
+class TriangulationCache {
+public:
+    static constexpr size_t SHARDS_COUNT = 16;
+    static constexpr size_t MAX_SHARD_BYTES = 4 * 1024 * 1024;
+    // Smaller loops are triangulated faster than they are hashed
+    static constexpr size_t MIN_VERTICES_COUNT = 8;
+    static constexpr double QUANTUM = 1e-6;
+
+    // Projected loops with the position and rotation in the plane removed: coordinates are taken relative to the
+    // centroid of the outer loop, rotated so that its first vertex lies on the x axis and rounded to QUANTUM
+    class Key {
+    public:
+        // Polygon is a list of rings in the form taken by earcut, coordinates are read with mapbox::util::nth
+        template<typename TPolygon>
+        explicit Key( const TPolygon& polygon ) {
+            using TPoint = typename std::decay_t<decltype( polygon[ 0 ] )>::value_type;
+            auto x = []( const TPoint& p ) { return mapbox::util::nth<0, TPoint>::get( p ); };
+            auto y = []( const TPoint& p ) { return mapbox::util::nth<1, TPoint>::get( p ); };
+            const auto& outer = polygon[ 0 ];
+            double cx = 0, cy = 0;
+            for( size_t i = 0; i < outer.size(); i++ ) {
+                cx += x( outer[ i ] );
+                cy += y( outer[ i ] );
+            }
+            cx /= (double)outer.size();
+            cy /= (double)outer.size();
+
+            double cos = 1, sin = 0;
+            const double dx = x( outer[ 0 ] ) - cx;
+            const double dy = y( outer[ 0 ] ) - cy;
+            const double length = std::sqrt( dx * dx + dy * dy );
+            if( length > QUANTUM ) {
+                cos = dx / length;
+                sin = dy / length;
+            }
+
+            size_t valuesCount = 0;
+            for( size_t l = 0; l < polygon.size(); l++ ) {
+                valuesCount += 1 + polygon[ l ].size() * 2;
+            }
+            this->m_values.reserve( valuesCount );
+            uint64_t hash = 14695981039346656037ull;
+            auto add = [ & ]( int64_t value ) {
+                this->m_values.push_back( value );
+                hash = ( hash ^ (uint64_t)value ) * 1099511628211ull;
+            };
+            for( size_t l = 0; l < polygon.size(); l++ ) {
+                const auto& loop = polygon[ l ];
+                add( (int64_t)loop.size() );
+                for( size_t i = 0; i < loop.size(); i++ ) {
+                    const double px = x( loop[ i ] ) - cx;
+                    const double py = y( loop[ i ] ) - cy;
+                    add( std::llround( ( px * cos + py * sin ) / QUANTUM ) );
+                    add( std::llround( ( py * cos - px * sin ) / QUANTUM ) );
+                }
+            }
+            this->m_hash = hash;
+        }
+
+        [[nodiscard]] inline bool operator==( const Key& other ) const {
+            return this->m_hash == other.m_hash && this->m_values == other.m_values;
+        }
+
+    private:
+        friend class TriangulationCache;
+        std::vector<int64_t> m_values;
+        uint64_t m_hash;
+    };
+
+    static inline TriangulationCache& Get() {
+        static TriangulationCache cache;
+        return cache;
+    }
+
+    inline std::optional<std::vector<int>> Find( const Key& key ) {
+        auto& shard = this->GetShard( key );
+        std::lock_guard lock( shard.m_mutex );
+        auto it = shard.m_entries.find( key.m_hash );
+        if( it == shard.m_entries.end() || !( it->second->m_key == key ) ) {
+            this->m_misses++;
+            return std::nullopt;
+        }
+        shard.m_lru.splice( shard.m_lru.begin(), shard.m_lru, it->second );
+        this->m_hits++;
+        return it->second->m_indices;
+    }
+
+    inline void Insert( Key key, const std::vector<int>& indices ) {
+        auto& shard = this->GetShard( key );
+        std::lock_guard lock( shard.m_mutex );
+        auto it = shard.m_entries.find( key.m_hash );
+        if( it != shard.m_entries.end() ) {
+            // Another thread got there first, or a hash collision: the newer loop wins
+            shard.m_bytes -= it->second->GetBytes();
+            shard.m_lru.erase( it->second );
+            shard.m_entries.erase( it );
+        }
+        const auto hash = key.m_hash;
+        shard.m_lru.push_front( { std::move( key ), indices } );
+        shard.m_entries[ hash ] = shard.m_lru.begin();
+        shard.m_bytes += shard.m_lru.front().GetBytes();
+        while( shard.m_bytes > MAX_SHARD_BYTES && shard.m_lru.size() > 1 ) {
+            const auto& last = shard.m_lru.back();
+            shard.m_bytes -= last.GetBytes();
+            shard.m_entries.erase( last.m_key.m_hash );
+            shard.m_lru.pop_back();
+        }
+    }
+
+    inline void LogStatistics() const {
+        const size_t hits = this->m_hits;
+        const size_t misses = this->m_misses;
+        spdlog::info( "triangulation cache: {} hits, {} misses, hit rate {:.1f}%", hits, misses, hits + misses ? 100.0 * hits / ( hits + misses ) : 0.0 );
+    }
+
+private:
+    struct Entry {
+        Key m_key;
+        std::vector<int> m_indices;
+
+        [[nodiscard]] inline size_t GetBytes() const {
+            return sizeof( Entry ) + this->m_key.m_values.size() * sizeof( int64_t ) + this->m_indices.size() * sizeof( int );
+        }
+    };
+
+    struct Shard {
+        std::mutex m_mutex;
+        std::list<Entry> m_lru;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> m_entries;
+        size_t m_bytes = 0;
+    };
+
+    std::array<Shard, SHARDS_COUNT> m_shards;
+    std::atomic<size_t> m_hits = 0;
+    std::atomic<size_t> m_misses = 0;
+
+    inline Shard& GetShard( const Key& key ) {
+        // The low bits select the bucket inside the shard map, use the high ones for the shard
+        return this->m_shards[ ( key.m_hash >> 60 ) % SHARDS_COUNT ];
+    }
+};
+
+};
@@ -27,6 +27,11 @@
 #include <memory>
 #include <vector>
 
+// Allocator template used for polygon vertex lists, may be defined before including this header
+#ifndef CSG_VERTEX_ALLOCATOR
+#define CSG_VERTEX_ALLOCATOR std::allocator
+#endif
+
 
 namespace csg {
 
@@ -101,6 +106,8 @@ inline Vector operator-( const Vector& a ) {
     return { -a.x, -a.y, -a.z };
 }
 
+using VertexList = std::vector<Vector, CSG_VERTEX_ALLOCATOR<Vector>>;
+
 
 struct Plane {
     Vector normal;
@@ -108,7 +115,7 @@ struct Plane {
 
     Plane() = default;
 
-    explicit Plane( const std::vector<Vector>& points ) {
+    explicit Plane( const VertexList& points ) {
         if( points.empty() ) {
             return;
         }
@@ -151,14 +158,17 @@ struct Plane {
 };
 
 struct Polygon {
-    std::vector<Vector> vertices;
+    VertexList vertices;
     Plane plane;
+    // User data (e.g. material index), copied to every fragment the polygon is split into
+    uint32_t attribute = 0;
 
     Polygon() = default;
 
     Polygon( Polygon&& other ) noexcept
         : vertices( std::move( other.vertices ) )
-        , plane( other.plane ) {
+        , plane( other.plane )
+        , attribute( other.attribute ) {
     }
 
     Polygon( const Polygon& other ) = default;
@@ -166,19 +176,33 @@ struct Polygon {
     Polygon& operator=( Polygon&& other ) noexcept {
         this->vertices = std::move( other.vertices );
         this->plane = other.plane;
+        this->attribute = other.attribute;
         return *this;
     }
 
     Polygon& operator=( const Polygon& other ) = default;
 
-    explicit Polygon( const std::vector<Vector>& list )
+    explicit Polygon( const VertexList& list )
         : vertices( list )
         , plane( list ) {
     }
 
-    Polygon( const std::vector<Vector>& list, const Plane& plane )
+    Polygon( const VertexList& list, const Plane& plane, uint32_t attribute = 0 )
         : vertices( list )
-        , plane( plane ) {
+        , plane( plane )
+        , attribute( attribute ) {
+    }
+
+    // Take over the vertex list instead of copying it
+    explicit Polygon( VertexList&& list )
+        : vertices( std::move( list ) )
+        , plane( vertices ) {
+    }
+
+    Polygon( VertexList&& list, const Plane& plane, uint32_t attribute = 0 )
+        : vertices( std::move( list ) )
+        , plane( plane )
+        , attribute( attribute ) {
     }
 
     inline void Flip() {
@@ -219,7 +243,7 @@ namespace details {
             break;
         }
         case Plane::SPANNING: {
-            std::vector<Vector> f, b;
+            VertexList f, b;
 
             for( size_t i = 0; i < poly.vertices.size(); i++ ) {
 
@@ -249,9 +273,9 @@ namespace details {
                 }
             }
             if( f.size() >= 3 && Plane( f ).IsValid() )
-                front.emplace_back( f, poly.plane );
+                front.emplace_back( std::move( f ), poly.plane, poly.attribute );
             if( b.size() >= 3 && Plane( b ).IsValid() )
-                back.emplace_back( b, poly.plane );
+                back.emplace_back( std::move( b ), poly.plane, poly.attribute );
             break;
         }
         default:
@@ -470,6 +494,46 @@ namespace details {
 #endif
         }
 
+        // ClipTo leaves nodes whose polygons were all clipped away, but their planes still take part in later
+        // clipping, so they can't simply be unlinked. When such nodes dominate the tree, rebuild it from the
+        // remaining polygons: every node of a freshly built tree owns at least one polygon.
+        inline void Compact() {
+            size_t nodesCount = 0;
+            size_t emptyNodesCount = 0;
+
+            std::deque<CSGNode*> nodes;
+            nodes.push_back( this );
+            while( !nodes.empty() ) {
+                CSGNode* me = nodes.front();
+                nodes.pop_front();
+
+                nodesCount++;
+                if( me->polygons.empty() ) {
+                    emptyNodesCount++;
+                }
+                me->polygons.shrink_to_fit();
+                if( me->front ) {
+                    nodes.push_back( me->front );
+                }
+                if( me->back ) {
+                    nodes.push_back( me->back );
+                }
+            }
+
+            if( emptyNodesCount * 2 <= nodesCount ) {
+                return;
+            }
+
+            auto list = this->allpolygons();
+            delete this->front;
+            delete this->back;
+            this->front = nullptr;
+            this->back = nullptr;
+            this->polygons = {};
+            this->plane = Plane();
+            Build( list );
+        }
+
         [[nodiscard]] inline std::vector<Polygon> clippolygons( const std::vector<Polygon>& ilist ) const {
             std::vector<Polygon> result;
 
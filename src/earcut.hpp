@@ -28,6 +28,17 @@ namespace detail {
         std::vector<N> indices;
         std::size_t vertices = 0;
 
+        // The node pool and the index buffer are kept between calls, so an instance reused for many polygons
+        // stops allocating once it has seen the largest one. Pools above this many nodes are freed after a call.
+        static constexpr std::size_t MAX_RETAINED_NODES = 1 << 16;
+
+        // For polygons indexed in z-order, the candidate points of an ear are gathered into blocks and tested
+        // against the ear all at once, and the z-order codes are computed in one pass over the coordinates. The
+        // loops over the blocks have no branches or pointer chasing, so the compiler vectorizes them. The result
+        // is the same either way. Off by default: on the profiles we measured, few candidates get past the
+        // bounding box of the ear and walking the z-order list dominates, see BenchmarkEarcutKernels.
+        bool batched = false;
+
         template <typename Polygon>
         void operator()(const Polygon& points);
 
@@ -63,6 +74,7 @@ namespace detail {
         void earcutLinked(Node* ear, int pass = 0);
         bool isEar(Node* ear);
         bool isEarHashed(Node* ear);
+        bool isEarHashedBatched(Node* ear);
         Node* cureLocalIntersections(Node* start);
         void splitEarcut(Node* start);
         template <typename Polygon> Node* eliminateHoles(const Polygon& points, Node* outerNode);
@@ -72,6 +84,7 @@ namespace detail {
         void indexCurve(Node* start);
         Node* sortLinked(Node* list);
         int32_t zOrder(const double x_, const double y_);
+        void zOrders(std::size_t count);
         Node* getLeftmost(Node* start);
         bool pointInTriangle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py) const;
         bool isValidDiagonal(Node* a, Node* b);
@@ -105,8 +118,13 @@ namespace detail {
             template <typename... Args>
             T* construct(Args&&... args) {
                 if (currentIndex >= blockSize) {
-                    currentBlock = alloc_traits::allocate(alloc, blockSize);
-                    allocations.emplace_back(currentBlock);
+                    if (blockIndex + 1 < allocations.size()) {
+                        currentBlock = allocations[++blockIndex];
+                    } else {
+                        currentBlock = alloc_traits::allocate(alloc, blockSize);
+                        allocations.emplace_back(currentBlock);
+                        blockIndex = allocations.size() - 1;
+                    }
                     currentIndex = 0;
                 }
                 T* object = &currentBlock[currentIndex++];
@@ -123,8 +141,21 @@ namespace detail {
                 currentIndex = blockSize;
             }
             void clear() { reset(blockSize); }
+            // Starts over in the blocks already allocated, unless they are smaller than newBlockSize. Objects
+            // are overwritten without being destroyed, like in reset.
+            void rewind(std::size_t newBlockSize) {
+                if (allocations.empty() || newBlockSize > blockSize) {
+                    reset(newBlockSize);
+                    return;
+                }
+                blockIndex = 0;
+                currentBlock = allocations[0];
+                currentIndex = 0;
+            }
+            std::size_t capacity() const { return allocations.size() * blockSize; }
         private:
             T* currentBlock = nullptr;
+            std::size_t blockIndex = 0;
             std::size_t currentIndex = 1;
             std::size_t blockSize = 1;
             std::vector<T*> allocations;
@@ -132,6 +163,32 @@ namespace detail {
             typedef typename std::allocator_traits<Alloc> alloc_traits;
         };
         ObjectPool<Node> nodes;
+        std::vector<Node*> holeQueue;
+
+        // Structure of arrays of points waiting to be tested against an ear. Unused lanes are set to NaN,
+        // which is never inside, so the test always runs over the whole block.
+        struct PointBatch {
+            static constexpr std::size_t SIZE = 16;
+
+            double x[SIZE];
+            double y[SIZE];
+            const Node* nodes[SIZE];
+            std::size_t size = 0;
+
+            void add(const Node* p) {
+                x[size] = p->x;
+                y[size] = p->y;
+                nodes[size++] = p;
+            }
+            bool full() const { return size == SIZE; }
+        };
+        bool batchBlocksEar(PointBatch& batch, const Node* a, const Node* b, const Node* c);
+
+        // Coordinates and codes of the nodes indexed by indexCurve
+        std::vector<Node*> zNodes;
+        std::vector<double> zX;
+        std::vector<double> zY;
+        std::vector<int32_t> zCodes;
     };
 
     template <typename N> template <typename Polygon>
@@ -153,7 +210,7 @@ namespace detail {
         }
 
         //estimate size of nodes and indices
-        nodes.reset(len * 3 / 2);
+        nodes.rewind(len * 3 / 2);
         indices.reserve(len + points[0].size());
 
         Node* outerNode = linkedList(points[0], true);
@@ -184,7 +241,13 @@ namespace detail {
 
         earcutLinked(outerNode);
 
-        nodes.clear();
+        if (nodes.capacity() > MAX_RETAINED_NODES) {
+            nodes.reset(1);
+            zNodes = {};
+            zX = {};
+            zY = {};
+            zCodes = {};
+        }
     }
 
     // create a circular doubly linked list from polygon points in the specified winding order
@@ -271,7 +334,7 @@ namespace detail {
             prev = ear->prev;
             next = ear->next;
 
-            if (hashing ? isEarHashed(ear) : isEar(ear)) {
+            if (hashing ? (batched ? isEarHashedBatched(ear) : isEarHashed(ear)) : isEar(ear)) {
                 // cut off the triangle
                 indices.emplace_back(prev->i);
                 indices.emplace_back(ear->i);
@@ -368,6 +431,66 @@ namespace detail {
         return true;
     }
 
+    // isEarHashed with the candidate points of both z-order directions tested in blocks
+    template <typename N>
+    bool Earcut<N>::isEarHashedBatched(Node* ear) {
+        const Node* a = ear->prev;
+        const Node* b = ear;
+        const Node* c = ear->next;
+
+        if (area(a, b, c) >= 0) return false; // reflex, can't be an ear
+
+        const double minTX = std::min<double>(a->x, std::min<double>(b->x, c->x));
+        const double minTY = std::min<double>(a->y, std::min<double>(b->y, c->y));
+        const double maxTX = std::max<double>(a->x, std::max<double>(b->x, c->x));
+        const double maxTY = std::max<double>(a->y, std::max<double>(b->y, c->y));
+        const int32_t minZ = zOrder(minTX, minTY);
+        const int32_t maxZ = zOrder(maxTX, maxTY);
+
+        // most points in the z-order range are outside the bbox of the triangle and aren't gathered at all
+        auto isInBox = [&](const Node* p) {
+            return p->x >= minTX && p->x <= maxTX && p->y >= minTY && p->y <= maxTY && p != ear->prev && p != ear->next;
+        };
+        PointBatch batch;
+        for (Node* p = ear->nextZ; p && p->z <= maxZ; p = p->nextZ) {
+            if (!isInBox(p)) continue;
+            batch.add(p);
+            if (batch.full() && batchBlocksEar(batch, a, b, c)) return false;
+        }
+        for (Node* p = ear->prevZ; p && p->z >= minZ; p = p->prevZ) {
+            if (!isInBox(p)) continue;
+            batch.add(p);
+            if (batch.full() && batchBlocksEar(batch, a, b, c)) return false;
+        }
+        return !batchBlocksEar(batch, a, b, c);
+    }
+
+    // whether a point of the batch lies in the triangle and isn't reflex, the batch is emptied
+    template <typename N>
+    bool Earcut<N>::batchBlocksEar(PointBatch& batch, const Node* a, const Node* b, const Node* c) {
+        if (batch.size == 0) return false;
+        const double ax = a->x, ay = a->y, bx = b->x, by = b->y, cx = c->x, cy = c->y;
+        std::fill(batch.x + batch.size, batch.x + PointBatch::SIZE, std::numeric_limits<double>::quiet_NaN());
+        std::fill(batch.y + batch.size, batch.y + PointBatch::SIZE, std::numeric_limits<double>::quiet_NaN());
+        // same tests as pointInTriangle, combined without short-circuiting; a mask of doubles keeps the loop
+        // vectorizable with plain SSE2, which has no 64-bit integer compares
+        double inside[PointBatch::SIZE];
+        for (std::size_t i = 0; i < PointBatch::SIZE; i++) {
+            const double px = batch.x[i];
+            const double py = batch.y[i];
+            inside[i] = ((cx - px) * (ay - py) >= (ax - px) * (cy - py)) &
+                ((ax - px) * (by - py) >= (bx - px) * (ay - py)) &
+                ((bx - px) * (cy - py) >= (cx - px) * (by - py)) ? 1.0 : 0.0;
+        }
+        const std::size_t size = batch.size;
+        batch.size = 0;
+        for (std::size_t i = 0; i < size; i++) {
+            const Node* p = batch.nodes[i];
+            if (inside[i] != 0 && area(p->prev, p, p->next) >= 0) return true;
+        }
+        return false;
+    }
+
     // go through all polygon nodes and cure small local self-intersections
     template <typename N>
     typename Earcut<N>::Node*
@@ -428,7 +551,8 @@ namespace detail {
     Earcut<N>::eliminateHoles(const Polygon& points, Node* outerNode) {
         const size_t len = points.size();
 
-        std::vector<Node*> queue;
+        auto& queue = holeQueue;
+        queue.clear();
         for (size_t i = 1; i < len; i++) {
             Node* list = linkedList(points[i], false);
             if (list) {
@@ -535,12 +659,30 @@ namespace detail {
         assert(start);
         Node* p = start;
 
-        do {
-            p->z = p->z ? p->z : zOrder(p->x, p->y);
-            p->prevZ = p->prev;
-            p->nextZ = p->next;
-            p = p->next;
-        } while (p != start);
+        if (batched) {
+            zNodes.clear();
+            zX.clear();
+            zY.clear();
+            do {
+                zNodes.push_back(p);
+                zX.push_back(p->x);
+                zY.push_back(p->y);
+                p->prevZ = p->prev;
+                p->nextZ = p->next;
+                p = p->next;
+            } while (p != start);
+            zOrders(zNodes.size());
+            for (std::size_t i = 0; i < zNodes.size(); i++) {
+                zNodes[i]->z = zNodes[i]->z ? zNodes[i]->z : zCodes[i];
+            }
+        } else {
+            do {
+                p->z = p->z ? p->z : zOrder(p->x, p->y);
+                p->prevZ = p->prev;
+                p->nextZ = p->next;
+                p = p->next;
+            } while (p != start);
+        }
 
         p->prevZ->nextZ = nullptr;
         p->prevZ = nullptr;
@@ -637,6 +779,17 @@ namespace detail {
         return x | (y << 1);
     }
 
+    // zOrder of the first count coordinates in zX and zY, written to zCodes
+    template <typename N>
+    void Earcut<N>::zOrders(std::size_t count) {
+        zCodes.resize(count);
+        const double* xs = zX.data();
+        const double* ys = zY.data();
+        int32_t* codes = zCodes.data();
+        // zOrder only reads the bbox members, which codes can't alias, so the loop vectorizes after inlining
+        for (std::size_t i = 0; i < count; i++) codes[i] = zOrder(xs[i], ys[i]);
+    }
+
     // find the leftmost node of a polygon ring
     template <typename N>
     typename Earcut<N>::Node*
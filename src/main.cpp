@@ -1,23 +1,285 @@
 #define CSG_FIX_POLYGON_ORIENTATIONS_EXPERIMENTAL
 
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <optional>
+#include <tuple>
+#include <type_traits>
 #include <iostream>
+#include <new>
 #include <spdlog/spdlog.h>
 #include <ifcpp/ModelLoader.h>
+#include "Batch.h"
+#include "Benchmark.h"
+#include "Deduplication.h"
 #include "Engine.h"
+#include "GlbExporter.h"
+#include "IndexedAdapter.h"
+#include "MappedFile.h"
+#include "ModelCache.h"
+#include "PreviewAdapter.h"
+#include "Progress.h"
+#include "Streaming.h"
+#include "Trace.h"
 
 using namespace IfcppExample;
 
 
-std::vector<std::shared_ptr<Entity>> LoadModel( const std::string& filePath );
+// Counts the heap allocations per thread for --benchmark-allocations, the array and nothrow forms call this one
+void* operator new( std::size_t size ) {
+    heapAllocationsCount++;
+    if( void* p = std::malloc( size ? size : 1 ) ) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete( void* p ) noexcept {
+    std::free( p );
+}
+void operator delete( void* p, std::size_t ) noexcept {
+    std::free( p );
+}
+
+
+// Arguments of ifcpp::Parameters, kept in one place because they are part of the geometry cache key as well
+const auto parameterValues = std::make_tuple( 1e-6, 14, 5, 10000, 4 );
+
+std::shared_ptr<ifcpp::Parameters> CreateParameters();
+ModelCacheKey CreateCacheKey( const std::string& filePath, bool indexedMode );
+template<typename TAdapter>
+std::vector<typename TAdapter::TEntity> LoadModel( const std::string& filePath );
+
+int main( int argc, char** argv ) {
+    // --preview: show approximate booleans first and swap in the exact geometry when it is ready
+    // --stream: show entities as soon as they are finished, structural elements first, and swap in the consolidated model at the end
+    // --preview-resolution N: number of voxels along each axis of the preview boolean grid
+    // --indexed: keep the geometry as indexed triangle meshes, which need much less memory
+    // --release-ifc-objects: keep only the metadata of entities, so the parsed IFC model is freed after loading
+    // --lod-levels N: number of detail levels built for every mesh (1..3), 1 draws the full geometry only
+    // --no-cache: neither load the geometry from example.ifc.geometry nor write it there
+    // --batch PATH: process the IFC files in a directory, or listed in a text file, without a window, write <file>.stats.json for each and exit
+    // --batch-threads N: total number of threads of the batch, all hardware threads by default
+    // --batch-files N: number of files processed at once, the threads are split between them
+    // --batch-output DIR: write the stats files into DIR instead of next to the IFC files
+    // --batch-cache: write the geometry cache of every file of the batch, so the viewer opens them without processing
+    // --batch-glb: write every file of the batch as binary glTF next to its stats file
+    // --export-glb FILE: write example.ifc as binary glTF to FILE without a window and exit
+    // --glb-quantize: store the glTF positions as 16-bit integers (KHR_mesh_quantization)
+    // --trace FILE: write a Chrome trace (chrome://tracing, ui.perfetto.dev) of the run to FILE, needs a build with IFCPP_EXAMPLE_TRACE
+    // --benchmark-threads N: load the model on 1..N threads at once, log the throughput and exit
+    // --benchmark-default-allocator: with --benchmark-threads, repeat every load without the thread arenas for comparison
+    // --benchmark-input: read example.ifc through a stream and a mapping, tokenize it on 1..N threads, compare with the ifcpp load and exit
+    // --benchmark-triangulation: triangulate loops of increasing size, log the timings and exit
+    // --benchmark-loop-shapes: triangulate a typical mix of face loops with and without the convex fast path, log the timings and exit
+    // --benchmark-earcut-kernels: triangulate large profiles with the scalar and the batched earcut kernels, log the timings and exit
+    // --benchmark-allocations: build an entity through the copying and the moving factories, log the allocations and exit
+    // --benchmark-rendering N: load the model, render N frames from several distances, log the frame times and exit
+    bool previewMode = false;
+    bool streamMode = false;
+    bool indexedMode = false;
+    bool useCache = true;
+    std::string batchInput;
+    std::string tracePath;
+    std::string glbPath;
+    BatchOptions batchOptions;
+    int benchmarkThreads = 0;
+    bool benchmarkDefaultAllocator = false;
+    bool benchmarkInput = false;
+    bool benchmarkTriangulation = false;
+    bool benchmarkLoopShapes = false;
+    bool benchmarkEarcutKernels = false;
+    bool benchmarkAllocations = false;
+    int benchmarkFrames = 0;
+    for( int i = 1; i < argc; i++ ) {
+        if( !strcmp( argv[ i ], "--preview" ) ) {
+            previewMode = true;
+        } else if( !strcmp( argv[ i ], "--stream" ) ) {
+            streamMode = true;
+        } else if( !strcmp( argv[ i ], "--indexed" ) ) {
+            indexedMode = true;
+        } else if( !strcmp( argv[ i ], "--no-cache" ) ) {
+            useCache = false;
+        } else if( !strcmp( argv[ i ], "--batch" ) && i + 1 < argc ) {
+            batchInput = argv[ ++i ];
+        } else if( !strcmp( argv[ i ], "--batch-threads" ) && i + 1 < argc ) {
+            batchOptions.m_threadsCount = std::max( std::atoi( argv[ ++i ] ), 1 );
+        } else if( !strcmp( argv[ i ], "--batch-files" ) && i + 1 < argc ) {
+            batchOptions.m_filesCount = std::atoi( argv[ ++i ] );
+        } else if( !strcmp( argv[ i ], "--batch-output" ) && i + 1 < argc ) {
+            batchOptions.m_outputDirectory = argv[ ++i ];
+        } else if( !strcmp( argv[ i ], "--batch-cache" ) ) {
+            batchOptions.m_writeCache = true;
+        } else if( !strcmp( argv[ i ], "--batch-glb" ) ) {
+            batchOptions.m_writeGlb = true;
+        } else if( !strcmp( argv[ i ], "--export-glb" ) && i + 1 < argc ) {
+            glbPath = argv[ ++i ];
+        } else if( !strcmp( argv[ i ], "--glb-quantize" ) ) {
+            batchOptions.m_glbOptions.m_quantizePositions = true;
+        } else if( !strcmp( argv[ i ], "--trace" ) && i + 1 < argc ) {
+            tracePath = argv[ ++i ];
+        } else if( !strcmp( argv[ i ], "--release-ifc-objects" ) ) {
+            releaseIfcObjects = true;
+        } else if( !strcmp( argv[ i ], "--lod-levels" ) && i + 1 < argc ) {
+            lodLevelsCount = std::atoi( argv[ ++i ] );
+        } else if( !strcmp( argv[ i ], "--preview-resolution" ) && i + 1 < argc ) {
+            previewResolution = std::atoi( argv[ ++i ] );
+        } else if( !strcmp( argv[ i ], "--benchmark-threads" ) && i + 1 < argc ) {
+            benchmarkThreads = std::atoi( argv[ ++i ] );
+        } else if( !strcmp( argv[ i ], "--benchmark-default-allocator" ) ) {
+            benchmarkDefaultAllocator = true;
+        } else if( !strcmp( argv[ i ], "--benchmark-input" ) ) {
+            benchmarkInput = true;
+        } else if( !strcmp( argv[ i ], "--benchmark-triangulation" ) ) {
+            benchmarkTriangulation = true;
+        } else if( !strcmp( argv[ i ], "--benchmark-loop-shapes" ) ) {
+            benchmarkLoopShapes = true;
+        } else if( !strcmp( argv[ i ], "--benchmark-earcut-kernels" ) ) {
+            benchmarkEarcutKernels = true;
+        } else if( !strcmp( argv[ i ], "--benchmark-allocations" ) ) {
+            benchmarkAllocations = true;
+        } else if( !strcmp( argv[ i ], "--benchmark-rendering" ) && i + 1 < argc ) {
+            benchmarkFrames = std::atoi( argv[ ++i ] );
+        }
+    }
+
+    if( previewMode && streamMode ) {
+        spdlog::error( "--preview and --stream can't be combined" );
+        return -1;
+    }
+    if( ( previewMode || streamMode ) && indexedMode ) {
+        // Both modes finish with the geometry of Adapter, which is what gets cached as well
+        spdlog::warn( "--indexed is ignored with {}", previewMode ? "--preview" : "--stream" );
+        indexedMode = false;
+    }
+
+    // Written when main returns, after the loading threads have finished
+    std::optional<TraceSession> traceSession;
+    if( !tracePath.empty() ) {
+        traceSession.emplace( tracePath );
+    }
+
+    if( benchmarkThreads > 0 ) {
+        BenchmarkThreadScaling( "example.ifc", CreateParameters(), benchmarkThreads, benchmarkDefaultAllocator );
+        return 0;
+    }
+    if( benchmarkInput ) {
+        BenchmarkInput( "example.ifc", CreateParameters() );
+        return 0;
+    }
+    if( benchmarkTriangulation ) {
+        BenchmarkTriangulation();
+        return 0;
+    }
+    if( benchmarkLoopShapes ) {
+        BenchmarkLoopShapes();
+        return 0;
+    }
+    if( benchmarkEarcutKernels ) {
+        BenchmarkEarcutKernels();
+        return 0;
+    }
+    if( benchmarkAllocations ) {
+        BenchmarkAllocations();
+        return 0;
+    }
+
+    if( !batchInput.empty() ) {
+        std::filesystem::path root;
+        const auto files = CollectIfcFiles( batchInput, &root );
+        if( files.empty() ) {
+            spdlog::error( "No IFC files found in {}", batchInput );
+            return -1;
+        }
+        // Only the metadata of the entities is used, so every parsed model is freed as soon as it is loaded
+        releaseIfcObjects = true;
+        batchOptions.m_createCacheKey = []( const std::string& filePath ) { return CreateCacheKey( filePath, false ); };
+        return RunBatch( files, root, CreateParameters(), batchOptions ) == 0 ? 0 : -1;
+    }
+    if( !glbPath.empty() ) {
+        releaseIfcObjects = true;
+        return ExportGlb( LoadModel<Adapter>( "example.ifc" ), glbPath, batchOptions.m_glbOptions ) ? 0 : -1;
+    }
+
+    const auto startTime = std::chrono::high_resolution_clock::now();
+    auto millisecondsSinceStart = [ & ]() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::high_resolution_clock::now() - startTime ).count();
+    };
 
-int main() {
     InitEngine();
 
-    auto entities = LoadModel( "example.ifc" );
-    SendToGpu( entities );
+    // The cache key covers the IFC file and every option which changes the uploaded buffers. The preview and the
+    // streamed entities are only shown while the complete geometry is computed, so they don't change what is cached.
+    std::optional<ModelCache> cache;
+    std::optional<CachedModel> cachedModel;
+    if( useCache ) {
+        cache.emplace( "example.ifc.geometry", CreateCacheKey( "example.ifc", indexedMode ).m_hash );
+        cachedModel = cache->Load();
+    }
+    const ModelCache* cacheToWrite = cache ? &*cache : nullptr;
+
+    std::future<std::vector<std::shared_ptr<Entity>>> refinedEntities;
+    if( cachedModel ) {
+        UploadModel( cachedModel->m_model );
+        spdlog::info( "geometry of {} entities loaded from the cache: {} milliseconds after start", cachedModel->m_model.GetEntitiesCount(),
+                      millisecondsSinceStart() );
+    } else if( previewMode ) {
+        // The exact load starts first and runs alongside the preview load
+        refinedEntities = std::async( std::launch::async, []() { return LoadModel<Adapter>( "example.ifc" ); } );
+        SendToGpu( LoadModel<PreviewAdapter>( "example.ifc" ) );
+    } else if( streamMode ) {
+        refinedEntities = std::async( std::launch::async, []() { return LoadModel<StreamingAdapter>( "example.ifc" ); } );
+    } else if( indexedMode ) {
+        SendToGpu( LoadModel<IndexedAdapter>( "example.ifc" ), true, cacheToWrite );
+    } else {
+        SendToGpu( LoadModel<Adapter>( "example.ifc" ), true, cacheToWrite );
+    }
+
+    // ifcpp can't cancel a load, so the destructor of the future would block until a background load is complete,
+    // with the window already gone. The process exits without waiting instead, unless the trace needs the load.
+    auto shutdown = [ & ]() {
+        glfwDestroyWindow( window );
+        glfwTerminate();
+        if( refinedEntities.valid() && refinedEntities.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready ) {
+            if( traceSession ) {
+                spdlog::info( "waiting for the background load to finish the trace" );
+                refinedEntities.wait();
+            } else {
+                spdlog::info( "window closed before the background load finished, exiting without waiting for it" );
+                spdlog::default_logger()->flush();
+                std::fflush( nullptr );
+                std::quick_exit( 0 );
+            }
+        }
+        return 0;
+    };
 
+    if( benchmarkFrames > 0 ) {
+        BenchmarkRendering( benchmarkFrames );
+        return shutdown();
+    }
+
+    bool isFirstFrame = true;
+    bool isStreamShown = false;
     while( !glfwWindowShouldClose( window ) ) {
+        if( refinedEntities.valid() && refinedEntities.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready ) {
+            const auto streamedCount = streamedEntitiesCount;
+            SendToGpu( refinedEntities.get(), false, cacheToWrite );
+            if( streamMode ) {
+                spdlog::info( "complete geometry ready: {} milliseconds after start, {} entities were streamed before", millisecondsSinceStart(),
+                              streamedCount );
+            } else {
+                spdlog::info( "exact geometry ready: {} milliseconds after start", millisecondsSinceStart() );
+            }
+        } else if( streamMode && refinedEntities.valid() && DrainStream() > 0 && !isStreamShown ) {
+            isStreamShown = true;
+            spdlog::info( "first streamed geometry: {} milliseconds after start", millisecondsSinceStart() );
+        }
+
         int width, height;
         glfwGetFramebufferSize( window, &width, &height );
 
@@ -26,26 +288,52 @@ int main() {
 
         glfwSwapBuffers( window );
         glfwPollEvents();
+
+        if( isFirstFrame ) {
+            isFirstFrame = false;
+            spdlog::info( "time to first frame: {} milliseconds", millisecondsSinceStart() );
+        }
     }
 
-    glfwDestroyWindow( window );
-    glfwTerminate();
-    return 0;
+    return shutdown();
 }
 
-std::vector<std::shared_ptr<Entity>> LoadModel( const std::string& filePath ) {
-    auto onProgressChanged = []( double progress ) { spdlog::info( "progress changed: {}", progress ); };
+std::shared_ptr<ifcpp::Parameters> CreateParameters() {
+    return std::apply( []( auto... values ) { return std::make_shared<ifcpp::Parameters>( ifcpp::Parameters { values... } ); }, parameterValues );
+}
 
-    auto parameters = std::make_shared<ifcpp::Parameters>( ifcpp::Parameters { 1e-6, 14, 5, 10000, 4 } );
+ModelCacheKey CreateCacheKey( const std::string& filePath, bool indexedMode ) {
+    ModelCacheKey key;
+    key.AddFile( filePath );
+    std::apply( [ & ]( auto... values ) { ( key.Add( values ), ... ); }, parameterValues );
+    key.Add( indexedMode ).Add( lodLevelsCount );
+    return key;
+}
+
+template<typename TAdapter>
+std::vector<typename TAdapter::TEntity> LoadModel( const std::string& filePath ) {
+    ProgressReporter progress( filePath );
+
+    auto parameters = CreateParameters();
 
     auto processingStartTime = std::chrono::high_resolution_clock::now();
-    auto entities = ifcpp::LoadModel<Adapter>( filePath, parameters, onProgressChanged );
+    // ifcpp only takes a path and reads the file through a stream. Mapping it first lets the OS read the whole
+    // file into the page cache in the background, so the parser doesn't wait for the disk at every buffer refill.
+    const MappedFile input( filePath );
+    input.Advise( MappedFile::Access::WILL_NEED );
+    const auto loadStart = Tracer::Get().BeginLoad();
+    auto entities = ifcpp::LoadModel<TAdapter>( filePath, parameters, progress.GetCallback() );
+    Tracer::Get().EndLoad( loadStart );
+    if constexpr( std::is_base_of_v<Adapter, TAdapter> ) {
+        DeduplicateMeshes( entities );
+    }
     auto processingFinishTime = std::chrono::high_resolution_clock::now();
 
     auto processingTime = processingFinishTime - processingStartTime;
     auto processingTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>( processingTime ).count();
     auto processingTimeSec = std::chrono::duration_cast<std::chrono::seconds>( processingTime ).count();
     spdlog::info( "model processing: {} milliseconds ({} seconds)", processingTimeMs, processingTimeSec );
+    TriangulationCache::Get().LogStatistics();
 
     return entities;
 }